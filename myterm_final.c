@@ -2,6 +2,7 @@
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <X11/keysym.h>
+#include <X11/extensions/Xrender.h>
 #include <glob.h>
 #include <dirent.h>
 
@@ -23,14 +24,34 @@ typedef unsigned long u_long;
 #include <string.h>
 #include <unistd.h>
 #include <sys/wait.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <stdint.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#include <limits.h>
+#include <zlib.h>
+#include <regex.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <signal.h>
 #include <util.h>
 #include <sys/select.h>
+#include <poll.h>
 #include <sys/syslimits.h>
 #include <time.h>
 #include <ctype.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 #define HISTORY_FILE ".myterm_history"
 #define MAX_HISTORY 10000
 
@@ -39,14 +60,28 @@ typedef unsigned long u_long;
 #define TAB_HEIGHT 28
 #define TAB_WIDTH 140
 #define MAX_TABS 12
-#define MAX_LINES 20000
+#define MAX_LINES 65536 // hot lines per tab; older ones are compressed
+#define TB_CHUNK_SIZE (256 * 1024)
+#define TB_CHUNKS 16 // 4 MB of uncompressed scrollback text per tab
+#define WARM_BLOCK (64 * 1024)      // raw bytes per compressed block
+#define WARM_BUDGET (8 << 20)       // compressed bytes per tab before spilling to disk
+#define WARM_CACHE 4                // decompressed blocks kept per tab
+#define DEFAULT_SCROLLBACK_MB 64    // all tabs together; override with MYTERM_SCROLLBACK_MB
+#define SPILL_GROUP 256            // lines per absolute offset in the spill index
+#define SPILL_WINDOW (4 << 20)     // bytes of spill file mapped at a time
+#define SPILL_ALIGN (1 << 20)      // window start granularity (> TB_CHUNK_SIZE)
 #define INPUT_MAX 8192
 #define MAX_JOBS 64
+#define JOB_READ_BUDGET (64 << 10)    // bytes read from one job per loop turn
+#define JOB_ACTIVE_BUDGET (256 << 10) // the same for the active tab's jobs
+#define JOB_TURN_NS 4000000LL         // time per loop turn for reading job output
 volatile sig_atomic_t multiwatch_active = 1;
-pid_t fg_pid = -1;
 volatile sig_atomic_t ui_needs_redraw = 0;
-char pending_signal_msg[256] = "";
-volatile sig_atomic_t signal_msg_ready = 0;
+#define DEFAULT_FPS 60 // redraw cap; override with MYTERM_FPS
+volatile sig_atomic_t pending_sig = 0; // SIGINT/SIGTSTP received by MyTerm, for the active tab
+volatile sig_atomic_t child_exited = 0;
+int wake_pipe[2] = {-1, -1}; // self-pipe: signals and worker threads wake the event loop
+pthread_mutex_t ui_lock = PTHREAD_MUTEX_INITIALIZER; // held by main except while blocked in poll()
 extern int active; // ensure global scope
 
 typedef struct
@@ -55,38 +90,190 @@ typedef struct
     int master_fd; // fd to read job output (pipe or pty)
     int active;
     char cmd[256];
+    pid_t stage_pids[16]; // earlier pipeline stages still to be reaped (-1 = done)
+    int nstages;
+    int exited;       // reaped by reap_children; status/usage are valid
+    int lost;         // launched by a zygote that died: exit status unknown
+    int status;
+    struct rusage usage;
 } Job;
 
+/* Scrollback text lives in a ring of large arena chunks; each line is just an
+   (offset, length) descriptor into that arena. Chunks are recycled whole, so
+   dropping the oldest output never frees or moves individual lines. */
+typedef struct
+{
+    unsigned long long off; // logical byte offset into the arena stream
+    unsigned int len;
+} LineRef;
+
+/* Cold tier: the oldest lines are appended, each ending in '\n', to an
+   unlinked per-tab file. Only one offset per SPILL_GROUP lines is kept in
+   memory; the line starts of a group are recovered by scanning it when the
+   view first needs one of its lines. Reads go through a single mmap window
+   that moves as the view scrolls. */
+typedef struct
+{
+    FILE *fp;                     // buffered appender, NULL until the first spill
+    unsigned long long size;      // bytes appended (including still buffered)
+    unsigned long long flushed;   // bytes visible to mmap
+    int count;                    // lines in the file
+    int cap;                      // groups allocated
+    unsigned long long *group_off;
+    int idx_group;                // group whose line starts are in idx_off, -1 = none
+    unsigned long long idx_off[SPILL_GROUP + 1];
+    char *map;                    // current read window
+    unsigned long long map_off;
+    size_t map_len;
+} SpillStore;
+
+/* Warm tier: lines evicted from the arena are gathered into a staging
+   buffer, each followed by '\n', and every WARM_BLOCK bytes the buffer is
+   deflated into a block. A block keeps no per-line index; line starts are
+   recovered when it is inflated into one of the WARM_CACHE slots. When the
+   compressed total passes the budget the oldest block goes to the cold tier. */
+typedef struct
+{
+    unsigned char *z;
+    unsigned int zlen, rawlen;
+    long long first; // warm-line number of the first line
+    int nlines;
+} WarmBlock;
+
+typedef struct
+{
+    long long first; // block held by this slot, -1 = empty
+    char *raw;
+    unsigned int *off; // nlines + 1 line starts
+    unsigned long long tick;
+    unsigned int bytes;
+} WarmCacheSlot;
+
+typedef struct
+{
+    WarmBlock *blocks;            // oldest first
+    int nblocks, cap;
+    long long begin, end;         // warm-line numbers held: [begin, end)
+    char *stage;                  // newest lines, not yet compressed
+    unsigned int stage_len, stage_cap;
+    unsigned int *stage_off;
+    int stage_lines, stage_off_cap;
+    unsigned long long zbytes, rawbytes; // totals over blocks
+    unsigned long long budget;
+    WarmCacheSlot cache[WARM_CACHE];
+    unsigned long long tick;
+} WarmStore;
+
 typedef struct
 {
-    char *lines[MAX_LINES];
+    LineRef *lines;           // ring of MAX_LINES descriptors
+    int head;                 // ring slot of the oldest line
     int line_count;
+    char *chunks[TB_CHUNKS];  // arena storage, allocated on first use
+    unsigned long long tail;  // logical offset of the next free arena byte
+    unsigned long long chunk_no; // logical number of the chunk being filled
+    unsigned long long seq;   // lines ever created; absolute number of the next line
+    unsigned long long version; // bumped on every change, for redraw tracking
+    int open_line;            // last line has no '\n' yet and may still grow
+    int cursor;               // write position in the open line after '\r'/'\b'; -1 = its end
+    int esc_state;            // position inside an escape sequence being skipped
+    WarmStore warm;           // lines older than the ring, oldest first
+    SpillStore cold;          // lines older than the warm tier
 } TextBuffer;
 
+/* Ctrl+F state. hits lists matching scrollback line numbers (0 = oldest
+   line, across all tiers) in ascending order. */
+typedef struct
+{
+    int active;
+    int regex;                // query is a POSIX ERE (Tab toggles)
+    char query[256];
+    int qlen;
+    char searched[256];       // query the hits belong to, "" = none
+    int searched_regex;
+    int bad_regex;
+    regex_t re;
+    int re_ok;
+    int *hits;
+    int nhits;
+    int scanned;              // lines [0, scanned) are covered by hits
+    int cur;                  // selected hit, -1 = none
+    struct FindTask *task;    // search in flight, NULL = none
+    int reveal;               // scroll to cur when the next results land
+    unsigned long long gen;   // bumped on every change, for redraw tracking
+} FindState;
+
+// Command history index; see Persistent Command History
+typedef struct
+{
+    unsigned int key; // trigram + 1, 0 = empty slot
+    int *ids;
+    int n, cap;
+} HistPosting;
+
 typedef struct
 {
+    char **hist;            // the shared history array
+    int base;               // id of hist[0]
+    int next;               // id of the next entry added
+    HistPosting *tri;
+    int tri_cap, tri_used;  // power-of-two table
+    int *exact;             // newest id + 1 per distinct text, 0 = empty
+    int exact_cap, exact_used;
+    int *sorted;            // live ids ordered by (text, id)
+    int nsorted, sorted_cap;
+    int *maxtree;           // segment tree of max id over sorted, -1 = empty
+    int tree_leaves;        // power of two, 0 = no tree
+    int built_base;         // base at the last full build
+} HistIndex;
+
+// Ctrl+R finder results; indexes below refer to slots of ids
+typedef struct
+{
+    int *ids;        // distinct commands (history ids), newest first
+    int *freq;       // how often each was run
+    int nids;
+    int *match;      // slots matching query, newest first
+    int nmatch;
+    int has_match;   // match holds the result for query
+    int *ranked;     // the same slots, best first
+    int *score;
+    char query[256];
+    int sel, top;    // selected entry and first one shown
+    unsigned long long gen; // bumped on every change, for redraw tracking
+} HistFinder;
+
+typedef struct
+{
+    int id; // unique for the life of the process; survives close_tab compaction
     TextBuffer tb;
+    unsigned long long seen_version; // tb.version last drawn while this tab was active
+    unsigned long long last_viewed;  // view_clock when last drawn as the active tab
     char input[INPUT_MAX];
     int input_len;
     char title[64];
-    char cwd[PATH_MAX];
+    char cwd[PATH_MAX]; // applied only in this tab's children; MyTerm never chdirs
     Job jobs[MAX_JOBS];
     int job_count;
+    pid_t fg_pid; // last stage of the foreground pipeline, -1 = none
+    int jobs_pending; // check_jobs ran out of budget with output left to read
+    int job_rr;       // job check_jobs starts at, so each gets its turn first
     int scroll_offset;
     int multiline_mode;
-    char *history[MAX_HISTORY];
-    int hist_count;
-    int hist_index;
+    int hist_index; // id of the history entry shown by Up/Down, -1 = none
     int cursor_pos; // For Ctrl+A / Ctrl+E navigation
     int search_mode; /* 0 = off, 1 = on */
     char search_buf[256];
     int search_len;
+    HistFinder finder;
+    FindState find;
 
 } Tab;
 
 typedef struct
 {
     Tab *tab;
+    char cwd[PATH_MAX]; // the tab's directory when multiWatch started
     char cmds[8][256];
     int ncmds;
 } MultiWatchArgs;
@@ -95,470 +282,4369 @@ Tab tabs[MAX_TABS];
 int tab_count = 0, active = -1;
 extern Tab tabs[MAX_TABS]; // your global tab array
 
-// ===== Utility =====
-static void tb_init(TextBuffer *tb) { tb->line_count = 0; }
+/* Command history, one per process. Entries with the same text share one
+   interned copy; sess[i] is the id of the tab that ran items[i] (0 = read
+   from the history file or run in a tab that has since closed). */
+typedef struct
+{
+    char *items[MAX_HISTORY];
+    int sess[MAX_HISTORY];
+    int count;
+    int loaded;  // the loader has been started
+    int from_file;
+    char *map;   // private mapping of the file; loaded entries point into it
+    size_t map_len;
+    HistIndex hidx;
+} HistStore;
 
-static void tb_append(TextBuffer *tb, const char *s)
+static HistStore shared_hist = {.hidx = {.hist = shared_hist.items}};
+
+// ===== Control-byte scanner =====
+/* scan_ctrl(p, n) returns the offset of the first C0 control byte (< 0x20:
+   '\n', '\r', ESC, ...) in p[0..n), or n if there is none. The widest
+   implementation the CPU supports is picked on first use. */
+static size_t scan_ctrl_scalar(const char *p, size_t n)
 {
-    if (!s)
-        return;
-    const char *p = s;
-    while (*p)
+    for (size_t i = 0; i < n; i++)
+        if ((unsigned char)p[i] < 0x20)
+            return i;
+    return n;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static size_t scan_ctrl_sse2(const char *p, size_t n)
+{
+    const __m128i lim = _mm_set1_epi8(0x1f);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
     {
-        const char *nl = strchr(p, '\n');
-        int len = nl ? (int)(nl - p) : (int)strlen(p);
-        char *line = malloc(len + 1);
-        if (!line)
-            return;
-        memcpy(line, p, len);
-        line[len] = '\0';
-        if (tb->line_count >= MAX_LINES)
-        {
-            free(tb->lines[0]);
-            memmove(&tb->lines[0], &tb->lines[1], sizeof(char *) * (MAX_LINES - 1));
-            tb->line_count--;
-        }
-        tb->lines[tb->line_count++] = line;
-        // Automatically keep view scrolled to bottom unless user manually scrolled
-        if (active >= 0)
-        {
-            Tab *t = &tabs[active];
-            // Auto-scroll only if user was at bottom before
-            if (t->scroll_offset == 0)
-                ui_needs_redraw = 1;
-        }
-        if (!nl)
-            break;
-        p = nl + 1;
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        // v <= 0x1f (unsigned) exactly where min(v, 0x1f) == v
+        int m = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(v, lim), v));
+        if (m)
+            return i + __builtin_ctz(m);
     }
+    return i + scan_ctrl_scalar(p + i, n - i);
 }
 
-static void tb_free(TextBuffer *tb)
+__attribute__((target("avx2"))) static size_t scan_ctrl_avx2(const char *p, size_t n)
 {
-    for (int i = 0; i < tb->line_count; i++)
-        free(tb->lines[i]);
-    tb->line_count = 0;
+    const __m256i lim = _mm256_set1_epi8(0x1f);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        unsigned m = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(v, lim), v));
+        if (m)
+            return i + __builtin_ctz(m);
+    }
+    return i + scan_ctrl_sse2(p + i, n - i);
 }
-// ===== Persistent Command History =====
-static void load_history(Tab *t)
+#elif defined(__aarch64__)
+static size_t scan_ctrl_neon(const char *p, size_t n)
 {
-    char path[PATH_MAX];
-    snprintf(path, sizeof(path), "%s/%s", getenv("HOME"), HISTORY_FILE);
-    FILE *fp = fopen(path, "r");
-    if (!fp)
-        return;
+    const uint8x16_t lim = vdupq_n_u8(0x20);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        uint8x16_t hit = vcltq_u8(vld1q_u8((const uint8_t *)(p + i)), lim);
+        // narrow each byte lane to a nibble so the mask fits in 64 bits
+        uint64_t m = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hit), 4)), 0);
+        if (m)
+            return i + (__builtin_ctzll(m) >> 2);
+    }
+    return i + scan_ctrl_scalar(p + i, n - i);
+}
+#endif
+
+static size_t scan_ctrl_pick(const char *p, size_t n);
+static size_t (*scan_ctrl)(const char *p, size_t n) = scan_ctrl_pick;
 
-    char line[INPUT_MAX];
-    while (fgets(line, sizeof(line), fp))
+static size_t scan_ctrl_pick(const char *p, size_t n)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    scan_ctrl = __builtin_cpu_supports("avx2") ? scan_ctrl_avx2 : scan_ctrl_sse2;
+#elif defined(__aarch64__)
+    scan_ctrl = scan_ctrl_neon;
+#else
+    scan_ctrl = scan_ctrl_scalar;
+#endif
+    return scan_ctrl(p, n);
+}
+
+// ===== Substring kernel =====
+/* find_sub(h, n, nd, m) returns the first occurrence of nd[0..m) in h[0..n),
+   or NULL. The vector versions compare the needle's first and last byte
+   against 16 or 32 positions per step and run memcmp only where both hit. */
+static const char *find_sub_scalar(const char *h, size_t n, const char *nd, size_t m)
+{
+    if (m == 0)
+        return h;
+    for (size_t i = 0; i + m <= n; i++)
     {
-        line[strcspn(line, "\n")] = 0; // remove newline
-        if (strlen(line) == 0)
-            continue;
-        if (t->hist_count < MAX_HISTORY)
-            t->history[t->hist_count++] = strdup(line);
+        const char *c = memchr(h + i, nd[0], n - m + 1 - i);
+        if (!c)
+            return NULL;
+        if (memcmp(c, nd, m) == 0)
+            return c;
+        i = c - h;
     }
-    fclose(fp);
-    tb_append(&t->tb, "Command history loaded from ~/.myterm_history");
+    return NULL;
 }
 
-static void save_history(Tab *t)
+#if defined(__x86_64__) || defined(__i386__)
+static const char *find_sub_sse2(const char *h, size_t n, const char *nd, size_t m)
 {
-    char path[PATH_MAX];
-    snprintf(path, sizeof(path), "%s/%s", getenv("HOME"), HISTORY_FILE);
-    FILE *fp = fopen(path, "w");
-    if (!fp)
-        return;
+    if (m == 0 || m > n)
+        return m == 0 ? h : NULL;
+    const __m128i first = _mm_set1_epi8(nd[0]), last = _mm_set1_epi8(nd[m - 1]);
+    size_t i = 0;
+    for (; i + m - 1 + 16 <= n; i += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)(h + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(h + i + m - 1));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        for (; mask; mask &= mask - 1)
+            if (memcmp(h + i + __builtin_ctz(mask), nd, m) == 0)
+                return h + i + __builtin_ctz(mask);
+    }
+    return find_sub_scalar(h + i, n - i, nd, m);
+}
 
-    for (int i = 0; i < t->hist_count; i++)
-        fprintf(fp, "%s\n", t->history[i]);
-    fclose(fp);
+__attribute__((target("avx2"))) static const char *find_sub_avx2(const char *h, size_t n, const char *nd, size_t m)
+{
+    if (m == 0 || m > n)
+        return m == 0 ? h : NULL;
+    const __m256i first = _mm256_set1_epi8(nd[0]), last = _mm256_set1_epi8(nd[m - 1]);
+    size_t i = 0;
+    for (; i + m - 1 + 32 <= n; i += 32)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(h + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(h + i + m - 1));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+        for (; mask; mask &= mask - 1)
+            if (memcmp(h + i + __builtin_ctz(mask), nd, m) == 0)
+                return h + i + __builtin_ctz(mask);
+    }
+    return find_sub_sse2(h + i, n - i, nd, m);
 }
-static void search_history(Tab *t)
+#elif defined(__aarch64__)
+static const char *find_sub_neon(const char *h, size_t n, const char *nd, size_t m)
 {
-    tb_append(&t->tb, "Enter search term: ");
-    ui_needs_redraw = 1;
+    if (m == 0 || m > n)
+        return m == 0 ? h : NULL;
+    const uint8x16_t first = vdupq_n_u8(nd[0]), last = vdupq_n_u8(nd[m - 1]);
+    size_t i = 0;
+    for (; i + m - 1 + 16 <= n; i += 16)
+    {
+        uint8x16_t hit = vandq_u8(vceqq_u8(vld1q_u8((const uint8_t *)(h + i)), first),
+                                  vceqq_u8(vld1q_u8((const uint8_t *)(h + i + m - 1)), last));
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hit), 4)), 0);
+        for (; mask; mask &= ~(0xfULL << (__builtin_ctzll(mask) & ~3)))
+            if (memcmp(h + i + (__builtin_ctzll(mask) >> 2), nd, m) == 0)
+                return h + i + (__builtin_ctzll(mask) >> 2);
+    }
+    return find_sub_scalar(h + i, n - i, nd, m);
+}
+#endif
 
-    char term[INPUT_MAX];
-    int len = 0;
-    int c;
+// Resolved once on the main thread, before any search worker starts
+static const char *(*find_sub)(const char *h, size_t n, const char *nd, size_t m);
 
-    // read character by character from stdin
-    while ((c = getchar()) != '\n' && c != EOF && len < INPUT_MAX - 1)
-        term[len++] = c;
-    term[len] = '\0';
+static void find_sub_init(void)
+{
+    if (find_sub)
+        return;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    find_sub = __builtin_cpu_supports("avx2") ? find_sub_avx2 : find_sub_sse2;
+#elif defined(__aarch64__)
+    find_sub = find_sub_neon;
+#else
+    find_sub = find_sub_scalar;
+#endif
+}
 
-    if (len == 0)
+// ===== Utility =====
+static void tb_init(TextBuffer *tb)
+{
+    tb->lines = malloc(sizeof(LineRef) * MAX_LINES);
+    tb->head = 0;
+    tb->line_count = 0;
+    for (int i = 0; i < TB_CHUNKS; i++)
+        tb->chunks[i] = NULL;
+    tb->chunks[0] = malloc(TB_CHUNK_SIZE);
+    tb->tail = 0;
+    tb->chunk_no = 0;
+    tb->seq = 0;
+    tb->version = 0;
+    tb->open_line = 0;
+    tb->cursor = -1;
+    tb->esc_state = 0;
+    memset(&tb->warm, 0, sizeof(tb->warm));
+    tb->warm.budget = WARM_BUDGET;
+    for (int i = 0; i < WARM_CACHE; i++)
+        tb->warm.cache[i].first = -1;
+    memset(&tb->cold, 0, sizeof(tb->cold));
+    tb->cold.idx_group = -1;
+}
+
+/* i-th visible line (0 = oldest); text is not NUL-terminated */
+static const char *tb_line(const TextBuffer *tb, int i, int *len)
+{
+    const LineRef *l = &tb->lines[(tb->head + i) % MAX_LINES];
+    *len = (int)l->len;
+    return tb->chunks[(l->off / TB_CHUNK_SIZE) % TB_CHUNKS] + l->off % TB_CHUNK_SIZE;
+}
+
+// ----- Cold tier -----
+static void spill_close(SpillStore *sp)
+{
+    if (sp->map)
+        munmap(sp->map, sp->map_len);
+    if (sp->fp)
+        fclose(sp->fp);
+    free(sp->group_off);
+    memset(sp, 0, sizeof(*sp));
+    sp->idx_group = -1;
+}
+
+static int spill_open(SpillStore *sp)
+{
+    const char *dir = getenv("TMPDIR");
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/myterm-scrollback-XXXXXX", dir && *dir ? dir : "/tmp");
+    int fd = mkstemp(path);
+    if (fd < 0)
+        return -1;
+    unlink(path); // the file lives exactly as long as the tab
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    sp->fp = fdopen(fd, "w");
+    if (!sp->fp)
     {
-        tb_append(&t->tb, "No term entered.");
-        return;
+        close(fd);
+        return -1;
     }
+    setvbuf(sp->fp, NULL, _IOFBF, 1 << 16);
+    return 0;
+}
 
-    // --- 1️⃣ Exact match search ---
-    int exact_index = -1;
-    for (int i = t->hist_count - 1; i >= 0; i--)
+/* Append one evicted line. On any I/O failure the cold tier is dropped as a
+   whole, so the scrollback never shows a silent gap. */
+static void spill_append(SpillStore *sp, const char *s, unsigned int len)
+{
+    if (sp->count >= INT_MAX - MAX_LINES)
+        return;
+    if (!sp->fp && spill_open(sp) < 0)
+        return;
+    int g = sp->count / SPILL_GROUP;
+    if (sp->count % SPILL_GROUP == 0)
     {
-        if (strcmp(t->history[i], term) == 0)
+        if (g == sp->cap)
         {
-            exact_index = i;
-            break;
+            int cap = sp->cap ? sp->cap * 2 : 256;
+            unsigned long long *grp = realloc(sp->group_off, sizeof(*grp) * cap);
+            if (!grp)
+            {
+                spill_close(sp);
+                return;
+            }
+            sp->group_off = grp;
+            sp->cap = cap;
         }
+        sp->group_off[g] = sp->size;
     }
-
-    if (exact_index >= 0)
+    if (g == sp->idx_group)
+        sp->idx_group = -1;
+    if ((len > 0 && fwrite(s, 1, len, sp->fp) != len) || fputc('\n', sp->fp) == EOF)
     {
-        char msg[INPUT_MAX + 64];
-        snprintf(msg, sizeof(msg),
-                 "Exact match found: %s", t->history[exact_index]);
-        tb_append(&t->tb, msg);
+        spill_close(sp);
         return;
     }
+    sp->size += len + 1;
+    sp->count++;
+}
 
-    // --- Substring match (longest) ---
-    int best_len = 0;
-    char *matches[20];
-    int mcount = 0;
+/* Map [off, end) of the file, which must span at most SPILL_WINDOW -
+   SPILL_ALIGN bytes; the pointer stays valid until the next call. */
+static const char *spill_map(SpillStore *sp, unsigned long long off, unsigned long long end)
+{
+    if (!sp->map || off < sp->map_off || end > sp->map_off + sp->map_len)
+    {
+        if (end > sp->flushed)
+        {
+            fflush(sp->fp);
+            sp->flushed = sp->size;
+        }
+        if (sp->map)
+            munmap(sp->map, sp->map_len);
+        sp->map_off = off / SPILL_ALIGN * SPILL_ALIGN;
+        sp->map_len = sp->flushed - sp->map_off < SPILL_WINDOW ? sp->flushed - sp->map_off : SPILL_WINDOW;
+        sp->map = mmap(NULL, sp->map_len, PROT_READ, MAP_SHARED, fileno(sp->fp), (off_t)sp->map_off);
+        if (sp->map == MAP_FAILED)
+        {
+            sp->map = NULL;
+            return NULL;
+        }
+    }
+    return sp->map + (off - sp->map_off);
+}
 
-    for (int i = 0; i < t->hist_count; i++)
+// Recover the line starts of group g by scanning it for '\n'
+static int spill_index_group(SpillStore *sp, int g)
+{
+    if (sp->idx_group == g)
+        return 0;
+    sp->idx_group = -1;
+    int n = sp->count - g * SPILL_GROUP < SPILL_GROUP ? sp->count - g * SPILL_GROUP : SPILL_GROUP;
+    unsigned long long off = sp->group_off[g];
+    for (int k = 0; k < n; k++)
     {
-        const char *h = t->history[i];
-        for (int j = 0; j < len; j++)
+        sp->idx_off[k] = off;
+        for (;;)
         {
-            for (int k = len; k > j; k--)
+            unsigned long long stop = off + SPILL_ALIGN < sp->size ? off + SPILL_ALIGN : sp->size;
+            const char *p = spill_map(sp, off, stop);
+            if (!p)
+                return -1;
+            const char *nl = memchr(p, '\n', stop - off);
+            if (nl)
             {
-                int sublen = k - j;
-                if (sublen <= best_len || sublen <= 2)
-                    continue;
-                char sub[INPUT_MAX];
-                strncpy(sub, term + j, sublen);
-                sub[sublen] = '\0';
-                if (strstr(h, sub))
-                {
-                    if (sublen > best_len)
-                    {
-                        best_len = sublen;
-                        mcount = 0;
-                        matches[mcount++] = (char *)h;
-                    }
-                    else if (sublen == best_len && mcount < 20)
-                        matches[mcount++] = (char *)h;
-                    break;
-                }
+                off += nl - p + 1;
+                break;
             }
+            off = stop;
         }
     }
+    sp->idx_off[n] = off;
+    sp->idx_group = g;
+    return 0;
+}
 
-    if (best_len > 2 && mcount > 0)
-    {
-        tb_append(&t->tb, "Closest matches:");
-        for (int i = 0; i < mcount; i++)
-            tb_append(&t->tb, matches[i]);
-    }
-    else
-    {
-        tb_append(&t->tb, "No match for search term in history.");
-    }
+// Page in line i; the pointer stays valid until the next call
+static const char *spill_line(SpillStore *sp, int i, int *len)
+{
+    *len = 0;
+    if (spill_index_group(sp, i / SPILL_GROUP) < 0)
+        return "";
+    unsigned long long off = sp->idx_off[i % SPILL_GROUP];
+    int n = (int)(sp->idx_off[i % SPILL_GROUP + 1] - off - 1);
+    const char *p = n > 0 ? spill_map(sp, off, off + n) : NULL;
+    if (!p)
+        return "";
+    *len = n;
+    return p;
 }
-/* return index in history for exact match (most recent), or -1 */
-static int history_exact_match(Tab *t, const char *term)
+
+// ----- Warm tier -----
+static int warm_count(const WarmStore *w)
 {
-    if (!term || term[0] == '\0')
-        return -1;
-    for (int i = t->hist_count - 1; i >= 0; --i)
-    {
-        if (strcmp(t->history[i], term) == 0)
-            return i;
-    }
-    return -1;
+    return (int)(w->end - w->begin);
 }
 
-/* return index of one history entry that contains the longest substring
-   of 'term' (substring length must be >2), or -1 if none */
-static int history_longest_substring(Tab *t, const char *term)
+static int warm_grow(void **p, int *cap, int need, size_t elem)
 {
-    if (!term)
-        return -1;
-    int tlen = strlen(term);
-    if (tlen < 3)
+    if (need <= *cap)
+        return 0;
+    int n = *cap ? *cap : 64;
+    while (n < need)
+        n *= 2;
+    void *q = realloc(*p, elem * n);
+    if (!q)
         return -1;
-    int best_len = 0;
-    int best_idx = -1;
-    char sub[256];
+    *p = q;
+    *cap = n;
+    return 0;
+}
 
-    for (int i = 0; i < t->hist_count; ++i)
-    {
-        const char *h = t->history[i];
-        for (int len = tlen; len >= 3; --len)
-        { // attempt longer substrings first
-            for (int start = 0; start + len <= tlen; ++start)
-            {
-                if (len >= (int)sizeof(sub))
-                    continue;
-                memcpy(sub, term + start, len);
-                sub[len] = '\0';
-                if (strstr(h, sub))
-                {
-                    if (len > best_len)
-                    {
-                        best_len = len;
-                        best_idx = i;
-                    }
-                    goto next_history_entry; // found a substring for this history line
-                }
-            }
+// Inflate a block into raw (rawlen bytes); returns 0 on success
+static int warm_inflate(const WarmBlock *b, char *raw)
+{
+    uLongf n = b->rawlen;
+    return uncompress((Bytef *)raw, &n, b->z, b->zlen) == Z_OK && n == b->rawlen ? 0 : -1;
+}
+
+static void warm_drop_cache(WarmStore *w, long long first)
+{
+    for (int i = 0; i < WARM_CACHE; i++)
+        if (w->cache[i].first == first)
+        {
+            free(w->cache[i].raw);
+            free(w->cache[i].off);
+            w->cache[i].raw = NULL;
+            w->cache[i].off = NULL;
+            w->cache[i].first = -1;
+            w->cache[i].bytes = 0;
         }
-    next_history_entry:;
-    }
-    return best_idx;
 }
 
-static void set_nonblock(int fd)
+// Move the oldest block to the cold tier
+static void warm_evict_block(WarmStore *w, SpillStore *cold)
 {
-    int f = fcntl(fd, F_GETFL, 0);
-    if (f >= 0)
-        fcntl(fd, F_SETFL, f | O_NONBLOCK);
+    WarmBlock *b = &w->blocks[0];
+    char *raw = malloc(b->rawlen ? b->rawlen : 1);
+    if (raw && warm_inflate(b, raw) == 0)
+        for (char *p = raw, *end = raw + b->rawlen; p < end;)
+        {
+            char *nl = memchr(p, '\n', end - p);
+            spill_append(cold, p, nl - p);
+            p = nl + 1;
+        }
+    else
+        spill_close(cold); // keep tiers contiguous: the block's lines are lost
+    free(raw);
+    warm_drop_cache(w, b->first);
+    w->begin += b->nlines;
+    w->zbytes -= b->zlen;
+    w->rawbytes -= b->rawlen;
+    free(b->z);
+    memmove(w->blocks, w->blocks + 1, sizeof(WarmBlock) * --w->nblocks);
 }
 
-// ===== Job Handling =====
-static void add_job(Tab *t, pid_t pid, int master_fd, const char *cmd)
+static void warm_seal(WarmStore *w, SpillStore *cold)
 {
-    if (t->job_count >= MAX_JOBS)
-        return;
-    t->jobs[t->job_count].pid = pid;
-    t->jobs[t->job_count].master_fd = master_fd;
-    t->jobs[t->job_count].active = 1;
-    strncpy(t->jobs[t->job_count].cmd, cmd, sizeof(t->jobs[t->job_count].cmd) - 1);
-    t->jobs[t->job_count].cmd[sizeof(t->jobs[t->job_count].cmd) - 1] = '\0';
-    if (master_fd >= 0)
-        set_nonblock(master_fd);
-    t->job_count++;
+    uLongf zlen = compressBound(w->stage_len);
+    unsigned char *z = malloc(zlen);
+    if (!z || warm_grow((void **)&w->blocks, &w->cap, w->nblocks + 1, sizeof(WarmBlock)) < 0 ||
+        compress2(z, &zlen, (const Bytef *)w->stage, w->stage_len, Z_BEST_SPEED) != Z_OK)
+    {
+        free(z);
+        return; // stay staged; retried on the next append
+    }
+    unsigned char *fit = realloc(z, zlen);
+    WarmBlock *b = &w->blocks[w->nblocks++];
+    b->z = fit ? fit : z;
+    b->zlen = zlen;
+    b->rawlen = w->stage_len;
+    b->first = w->end - w->stage_lines;
+    b->nlines = w->stage_lines;
+    w->zbytes += zlen;
+    w->rawbytes += w->stage_len;
+    w->stage_len = 0;
+    w->stage_lines = 0;
+    while (w->nblocks > 0 && w->zbytes > w->budget)
+        warm_evict_block(w, cold);
 }
-// === Signal handlers for Ctrl+C (SIGINT) and Ctrl+Z (SIGTSTP) ===
-void handle_sigint(int sig)
+
+static void warm_append(WarmStore *w, SpillStore *cold, const char *s, unsigned int len)
+{
+    int cap = w->stage_cap;
+    if (warm_grow((void **)&w->stage, &cap, w->stage_len + len + 1, 1) < 0 ||
+        warm_grow((void **)&w->stage_off, &w->stage_off_cap, w->stage_lines + 1, sizeof(unsigned int)) < 0)
+        return; // out of memory: the line is lost
+    w->stage_cap = cap;
+    w->stage_off[w->stage_lines++] = w->stage_len;
+    memcpy(w->stage + w->stage_len, s, len);
+    w->stage_len += len;
+    w->stage[w->stage_len++] = '\n';
+    w->end++;
+    if (w->stage_len >= WARM_BLOCK)
+        warm_seal(w, cold);
+}
+
+// Line i of the warm tier (0 = oldest); valid until the next warm call
+static const char *warm_line(WarmStore *w, int i, int *len)
 {
-    if (fg_pid > 0)
+    long long n = w->begin + i;
+    const char *raw;
+    const unsigned int *off;
+    int k;
+    if (n >= w->end - w->stage_lines)
     {
-        kill(fg_pid, SIGINT);
-        snprintf(pending_signal_msg, sizeof(pending_signal_msg),
-                 "[MyTerm] Foreground process (%d) interrupted", fg_pid);
+        raw = w->stage;
+        off = w->stage_off;
+        k = (int)(n - (w->end - w->stage_lines));
+        unsigned int stop = k + 1 < w->stage_lines ? off[k + 1] : w->stage_len;
+        *len = (int)(stop - off[k] - 1);
+        return raw + off[k];
     }
-    else
+
+    int lo = 0, hi = w->nblocks - 1;
+    while (lo < hi)
     {
-        snprintf(pending_signal_msg, sizeof(pending_signal_msg),
-                 "[MyTerm] No foreground job to interrupt");
+        int mid = (lo + hi + 1) / 2;
+        if (w->blocks[mid].first <= n)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    WarmBlock *b = &w->blocks[lo];
+    WarmCacheSlot *slot = NULL;
+    for (int c = 0; c < WARM_CACHE && !slot; c++)
+        if (w->cache[c].first == b->first)
+            slot = &w->cache[c];
+    if (!slot)
+    {
+        slot = &w->cache[0];
+        for (int c = 1; c < WARM_CACHE; c++)
+            if (w->cache[c].tick < slot->tick)
+                slot = &w->cache[c];
+        free(slot->raw);
+        free(slot->off);
+        slot->first = -1;
+        slot->raw = malloc(b->rawlen);
+        slot->off = malloc(sizeof(unsigned int) * (b->nlines + 1));
+        slot->bytes = b->rawlen + sizeof(unsigned int) * (b->nlines + 1);
+        if (!slot->raw || !slot->off || warm_inflate(b, slot->raw) < 0)
+        {
+            *len = 0;
+            return "";
+        }
+        int j = 0;
+        for (char *p = slot->raw, *end = slot->raw + b->rawlen; p < end; j++)
+        {
+            slot->off[j] = p - slot->raw;
+            p = (char *)memchr(p, '\n', end - p) + 1;
+        }
+        slot->off[j] = b->rawlen;
+        slot->first = b->first;
     }
-    signal_msg_ready = 1;
+    slot->tick = ++w->tick;
+    k = (int)(n - b->first);
+    *len = (int)(slot->off[k + 1] - slot->off[k] - 1);
+    return slot->raw + slot->off[k];
 }
 
-void handle_sigtstp(int sig)
+static void warm_free(WarmStore *w)
 {
-    if (fg_pid > 0)
+    for (int i = 0; i < w->nblocks; i++)
+        free(w->blocks[i].z);
+    for (int i = 0; i < WARM_CACHE; i++)
     {
-        kill(fg_pid, SIGTSTP);
-        snprintf(pending_signal_msg, sizeof(pending_signal_msg),
-                 "[MyTerm] Foreground process (%d) stopped (backgrounded)", fg_pid);
-        if (active >= 0)
-            add_job(&tabs[active], fg_pid, -1, "Suspended job");
-        fg_pid = -1;
+        free(w->cache[i].raw);
+        free(w->cache[i].off);
     }
-    else
+    free(w->blocks);
+    free(w->stage);
+    free(w->stage_off);
+    memset(w, 0, sizeof(*w));
+}
+
+static void tb_drop_oldest(TextBuffer *tb)
+{
+    int len;
+    const char *s = tb_line(tb, 0, &len);
+    warm_append(&tb->warm, &tb->cold, s, len);
+    tb->head = (tb->head + 1) % MAX_LINES;
+    tb->line_count--;
+}
+
+/* Return room for n contiguous bytes at the arena tail. Moving into a new
+   chunk recycles the oldest one, dropping every line that still points at it. */
+static char *tb_reserve(TextBuffer *tb, unsigned int n)
+{
+    unsigned long long used = tb->tail % TB_CHUNK_SIZE;
+    if (used + n > TB_CHUNK_SIZE)
+        tb->tail += TB_CHUNK_SIZE - used;
+
+    unsigned long long cn = tb->tail / TB_CHUNK_SIZE;
+    if (cn != tb->chunk_no)
     {
-        snprintf(pending_signal_msg, sizeof(pending_signal_msg),
-                 "[MyTerm] No foreground job to stop");
+        tb->chunk_no = cn;
+        if (cn >= TB_CHUNKS)
+        {
+            unsigned long long keep_from = (cn - TB_CHUNKS + 1) * TB_CHUNK_SIZE;
+            while (tb->line_count > 0 && tb->lines[tb->head].off < keep_from)
+                tb_drop_oldest(tb);
+        }
+        if (!tb->chunks[cn % TB_CHUNKS])
+            tb->chunks[cn % TB_CHUNKS] = malloc(TB_CHUNK_SIZE);
+        if (!tb->chunks[cn % TB_CHUNKS])
+            return NULL;
     }
-    signal_msg_ready = 1;
+    return tb->chunks[cn % TB_CHUNKS] + tb->tail % TB_CHUNK_SIZE;
 }
 
-// check_jobs: non-blocking reads from job fds and read pids with WNOHANG
-static void check_jobs(Tab *t)
+static LineRef *tb_new_line(TextBuffer *tb, unsigned long long off)
 {
-    for (int i = 0; i < t->job_count; i++)
+    if (tb->line_count >= MAX_LINES)
+        tb_drop_oldest(tb);
+    LineRef *l = &tb->lines[(tb->head + tb->line_count) % MAX_LINES];
+    l->off = off;
+    l->len = 0;
+    tb->line_count++;
+    tb->seq++;
+    return l;
+}
+
+static void tb_push_line(TextBuffer *tb, const char *s, int len)
+{
+    tb->open_line = 0;
+    tb->cursor = -1;
+    if (len > TB_CHUNK_SIZE)
+        len = TB_CHUNK_SIZE;
+    char *dst = tb_reserve(tb, len);
+    if (!dst)
+        return;
+    memcpy(dst, s, len);
+    tb_new_line(tb, tb->tail)->len = len;
+    tb->tail += len;
+    tb->version++;
+}
+
+/* Append n bytes of plain text to the open line, opening one at the tail if
+   needed. The open line always ends at the tail, so it is re-reserved together
+   with the new bytes and moves to a fresh chunk when the two do not fit. */
+static void tb_extend(TextBuffer *tb, const char *s, size_t n)
+{
+    while (n > 0)
     {
-        if (!t->jobs[i].active)
+        LineRef *open = tb->open_line ? &tb->lines[(tb->head + tb->line_count - 1) % MAX_LINES] : NULL;
+        if (open && open->len >= TB_CHUNK_SIZE)
+            open = NULL; // overlong line: wrap it here
+        if (!open)
+        {
+            open = tb_new_line(tb, tb->tail);
+            tb->open_line = 1;
+        }
+        unsigned int olen = open->len;
+        size_t take = n < TB_CHUNK_SIZE - olen ? n : TB_CHUNK_SIZE - olen;
+
+        if (olen > 0 && tb->tail / TB_CHUNK_SIZE == tb->chunk_no &&
+            tb->tail % TB_CHUNK_SIZE + take <= TB_CHUNK_SIZE)
+        {
+            // fast path: room right after the open line in the current chunk
+            memcpy(tb->chunks[tb->chunk_no % TB_CHUNKS] + tb->tail % TB_CHUNK_SIZE, s, take);
+            open->len += take;
+            tb->tail += take;
+            s += take;
+            n -= take;
             continue;
+        }
 
-        // Read any available output from job master fd
-        if (t->jobs[i].master_fd >= 0)
+        int l;
+        const char *old = tb_line(tb, tb->line_count - 1, &l);
+        tb->tail = open->off;
+        char *dst = tb_reserve(tb, olen + take);
+        if (!dst)
+            return;
+        if (dst != old)
         {
-            char buf[4096];
-            ssize_t r;
-            while ((r = read(t->jobs[i].master_fd, buf, sizeof(buf) - 1)) > 0)
-            {
-                buf[r] = '\0';
-                tb_append(&t->tb, buf);
+            memcpy(dst, old, olen);
+            open->off = tb->tail;
+        }
+        memcpy(dst + olen, s, take);
+        open->len += take;
+        tb->tail = open->off + open->len;
+        s += take;
+        n -= take;
+    }
+}
+
+/* Write text at the cursor. After '\r' or '\b' it overwrites the open line
+   one character for each character written (a UTF-8 sequence counts as
+   one, so a sequence split across reads is still replaced whole); the line
+   is rebuilt at the tail with the rest kept after the new text. */
+static void tb_write(TextBuffer *tb, const char *s, size_t n)
+{
+    if (tb->cursor < 0 || !tb->open_line)
+    {
+        tb_extend(tb, s, n);
+        return;
+    }
+    LineRef *open = &tb->lines[(tb->head + tb->line_count - 1) % MAX_LINES];
+    int len;
+    const char *line = tb_line(tb, tb->line_count - 1, &len);
+    size_t at = tb->cursor, e = at, chars = 0;
+    for (size_t i = 0; i < n; i++)
+        chars += ((unsigned char)s[i] & 0xc0) != 0x80;
+    for (; e < (size_t)len && chars > 0; chars--)
+        for (e++; e < (size_t)len && ((unsigned char)line[e] & 0xc0) == 0x80; e++)
+            ;
+    size_t keep = len - e, total = at + n + keep;
+    char *tmp = malloc(total ? total : 1);
+    if (!tmp)
+        return;
+    memcpy(tmp, line, at);
+    memcpy(tmp + at, s, n);
+    memcpy(tmp + at + n, line + e, keep);
+    open->len = 0;
+    tb->tail = open->off;
+    tb_extend(tb, tmp, total);
+    free(tmp);
+    // still inside the line, unless it had to wrap
+    tb->cursor = keep && total <= TB_CHUNK_SIZE ? (int)(at + n) : -1;
+}
+
+/* Skip the body of an ESC sequence (CSI, OSC or two/three-byte forms); the
+   state survives across reads so a sequence split by a chunk boundary is
+   still consumed whole. */
+static const char *tb_skip_escape(TextBuffer *tb, const char *p, const char *end)
+{
+    while (p < end && tb->esc_state)
+    {
+        unsigned char c = *p++;
+        switch (tb->esc_state)
+        {
+        case 1: // just after ESC
+            if (c == '[')
+                tb->esc_state = 2;
+            else if (c == ']')
+                tb->esc_state = 3;
+            else if (c == '(' || c == ')' || c == '#' || c == '%')
+                tb->esc_state = 5;
+            else
+                tb->esc_state = 0;
+            break;
+        case 2: // CSI parameters until a final byte
+            if (c >= 0x40 && c <= 0x7e)
+                tb->esc_state = 0;
+            break;
+        case 3: // OSC string until BEL or ST
+            if (c == 0x07)
+                tb->esc_state = 0;
+            else if (c == 0x1b)
+                tb->esc_state = 4;
+            break;
+        case 4:
+            tb->esc_state = 0;
+            break;
+        default: // one designator byte
+            tb->esc_state = 0;
+            break;
+        }
+    }
+    return p;
+}
+
+/* Bulk append of raw job output. The vectorized scanner jumps between
+   control bytes; every printable run in between is copied into the arena once
+   and extends the current line, so the line index is built in the same pass.
+   Text after the last '\n' stays an open line that the next read() continues,
+   so chunk boundaries never turn into fake line breaks. */
+static void tb_append_bytes(TextBuffer *tb, const char *buf, size_t n)
+{
+    const char *p = buf, *end = buf + n;
+    tb->version++;
+    while (p < end)
+    {
+        if (tb->esc_state)
+        {
+            p = tb_skip_escape(tb, p, end);
+            continue;
+        }
+        size_t run = scan_ctrl(p, end - p);
+        if (run > 0)
+        {
+            tb_write(tb, p, run);
+            p += run;
+            continue;
+        }
+
+        unsigned char c = *p++;
+        if (c == '\n')
+        {
+            if (!tb->open_line)
+                tb_new_line(tb, tb->tail);
+            tb->open_line = 0;
+            tb->cursor = -1;
+        }
+        else if (c == '\r')
+            tb->cursor = tb->open_line ? 0 : -1; // later text overwrites from column 0
+        else if (c == 0x1b)
+            tb->esc_state = 1;
+        else if (c == '\t')
+        {
+            int len = tb->open_line ? (int)tb->lines[(tb->head + tb->line_count - 1) % MAX_LINES].len : 0;
+            int col = tb->cursor >= 0 ? tb->cursor : len, stop = col + 8 - col % 8;
+            if (stop < len)
+            {
+                // like a terminal, a tab moves over text without erasing it
+                const char *line = tb_line(tb, tb->line_count - 1, &len);
+                while (stop < len && ((unsigned char)line[stop] & 0xc0) == 0x80)
+                    stop++;
+                tb->cursor = stop < len ? stop : -1;
             }
-            if (r == 0)
+            else
             {
-                // EOF on job output - close fd (but still wait for process reap)
-                close(t->jobs[i].master_fd);
-                t->jobs[i].master_fd = -1;
+                tb->cursor = -1;
+                tb_extend(tb, "        ", stop - len);
             }
-            else if (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+        }
+        else if (c == '\b' && tb->open_line)
+        {
+            // step back over one whole character; the next text overwrites it
+            int len;
+            const char *line = tb_line(tb, tb->line_count - 1, &len);
+            int cur = tb->cursor >= 0 ? tb->cursor : len;
+            if (cur > 0)
             {
-                // Unexpected read error
-                close(t->jobs[i].master_fd);
-                t->jobs[i].master_fd = -1;
+                for (cur--; cur > 0 && ((unsigned char)line[cur] & 0xc0) == 0x80; cur--)
+                    ;
+                tb->cursor = cur;
             }
         }
+        // other C0 controls (BEL, ...) are dropped
+    }
+}
 
-        // Reap job if it finished
-        int st = 0;
-        pid_t done = waitpid(t->jobs[i].pid, &st, WNOHANG);
-        if (done > 0)
+static void tb_append(TextBuffer *tb, const char *s)
+{
+    if (!s)
+        return;
+    const char *p = s;
+    while (*p)
+    {
+        const char *nl = strchr(p, '\n');
+        int len = nl ? (int)(nl - p) : (int)strlen(p);
+        tb_push_line(tb, p, len);
+        // Automatically keep view scrolled to bottom unless user manually scrolled
+        if (active >= 0)
         {
-            // job finished
-            t->jobs[i].active = 0;
-            if (t->jobs[i].master_fd >= 0)
+            Tab *t = &tabs[active];
+            // Auto-scroll only if user was at bottom before
+            if (t->scroll_offset == 0)
+                ui_needs_redraw = 1;
+        }
+        if (!nl)
+            break;
+        p = nl + 1;
+    }
+}
+
+static void tb_free(TextBuffer *tb)
+{
+    for (int i = 0; i < TB_CHUNKS; i++)
+    {
+        free(tb->chunks[i]);
+        tb->chunks[i] = NULL;
+    }
+    free(tb->lines);
+    tb->lines = NULL;
+    tb->line_count = 0;
+    warm_free(&tb->warm);
+    spill_close(&tb->cold);
+}
+
+// Scrollback as the view sees it: cold lines, then warm, then the arena ring
+static int tb_total_lines(const TextBuffer *tb)
+{
+    return tb->cold.count + warm_count(&tb->warm) + tb->line_count;
+}
+
+static const char *tb_view_line(TextBuffer *tb, int i, int *len)
+{
+    if (i < tb->cold.count)
+        return spill_line(&tb->cold, i, len);
+    i -= tb->cold.count;
+    if (i < warm_count(&tb->warm))
+        return warm_line(&tb->warm, i, len);
+    return tb_line(tb, i - warm_count(&tb->warm), len);
+}
+
+// Heap bytes held by a buffer's in-memory tiers (the cold tier is on disk)
+static unsigned long long tb_memory(const TextBuffer *tb)
+{
+    unsigned long long n = sizeof(LineRef) * (unsigned long long)MAX_LINES;
+    for (int i = 0; i < TB_CHUNKS; i++)
+        n += tb->chunks[i] ? TB_CHUNK_SIZE : 0;
+    const WarmStore *w = &tb->warm;
+    n += w->zbytes + w->stage_cap + sizeof(unsigned int) * w->stage_off_cap + sizeof(WarmBlock) * w->cap;
+    for (int i = 0; i < WARM_CACHE; i++)
+        n += w->cache[i].bytes;
+    n += sizeof(unsigned long long) * (unsigned long long)tb->cold.cap;
+    return n;
+}
+
+/* Move everything but the open line to disk and free the memory it used.
+   The warm budget stays at zero, so new output keeps going straight to disk
+   until the tab is viewed again. */
+static void tb_compact(TextBuffer *tb)
+{
+    WarmStore *w = &tb->warm;
+    w->budget = 0;
+    while (tb->line_count > tb->open_line)
+        tb_drop_oldest(tb);
+    if (w->stage_lines > 0)
+        warm_seal(w, &tb->cold);
+    while (w->nblocks > 0)
+        warm_evict_block(w, &tb->cold);
+    for (int i = 0; i < WARM_CACHE; i++)
+        warm_drop_cache(w, w->cache[i].first);
+    if (w->stage_lines == 0) // the seal could fail under memory pressure
+    {
+        free(w->stage);
+        free(w->stage_off);
+        w->stage = NULL;
+        w->stage_off = NULL;
+        w->stage_cap = 0;
+        w->stage_off_cap = 0;
+    }
+
+    // keep only the chunks at the tail and under the open line
+    int open_chunk = tb->line_count > 0 ? (int)(tb->lines[tb->head].off / TB_CHUNK_SIZE % TB_CHUNKS) : -1;
+    for (int i = 0; i < TB_CHUNKS; i++)
+        if (i != (int)(tb->chunk_no % TB_CHUNKS) && i != open_chunk)
+        {
+            free(tb->chunks[i]);
+            tb->chunks[i] = NULL;
+        }
+}
+// ===== Scrollback search (Ctrl+F) =====
+/* A search splits the whole scrollback into units (runs of disk groups, warm
+   blocks, the warm staging buffer, slices of the hot ring) that worker
+   threads pull from a shared counter. Every unit is scanned as one
+   '\n'-separated buffer, so a literal query runs the substring kernel over
+   megabytes at a time. Results land per unit and are joined in order, which
+   keeps the hit list sorted by line.
+   The scan runs off the main thread, on a FindTask: under ui_lock find_run
+   copies what the units need (deflated warm blocks, staged and hot lines;
+   the spill file only grows, so it is mapped through its own descriptor),
+   then the task's thread searches without any lock and queues the task on
+   find_done. find_collect applies it if it is still its tab's latest; a
+   newer search or closing the tab sets cancel and the workers stop early. */
+#define FIND_MAX_THREADS 8
+#define FIND_UNIT_LINES 4096
+#define FIND_COLD_GROUPS (FIND_UNIT_LINES / SPILL_GROUP)
+
+enum
+{
+    FU_COLD,
+    FU_WARM,
+    FU_STAGE,
+    FU_HOT
+};
+
+typedef struct
+{
+    int kind, first, nlines;
+    unsigned long long off, end;  // FU_COLD: byte range in the mapped file
+    char *data;                   // otherwise a private copy: the deflated block (FU_WARM) or the lines
+    unsigned int len, rawlen;     // bytes in data; FU_WARM: inflated size
+} FindUnit;
+
+typedef struct FindTask
+{
+    char query[256];
+    int qlen, regex;
+    regex_t re;                   // own copy: the tab's is recompiled as the query changes
+    FindUnit *units;
+    int nunits;
+    int from;                     // lines below this are only checked if listed in cand
+    int *cand;                    // copy of the previous hits, or NULL
+    int ncand;
+    int cold_fd;                  // the spill file, -1 = no cold units
+    unsigned long long cold_size;
+    int keep;                     // previous hits below from that stay
+    int scanned;                  // lines covered once the task is applied
+    int *hits, nhits;             // result, nhits = -1 on failure
+    int cancel;                   // atomic: superseded, stop claiming units
+    struct FindTask *next;        // on find_done
+} FindTask;
+
+static FindTask *find_done; // finished tasks, newest first; ui_lock held
+
+typedef struct
+{
+    int *v;
+    int n, cap;
+} FindHits;
+
+typedef struct
+{
+    FindTask *task;
+    const char *cold_map;
+    FindHits *res;                // one per unit
+    int next;                     // next unit to claim (atomic)
+} FindJob;
+
+typedef struct
+{
+    char *raw;                    // inflated warm block
+    size_t raw_cap;
+    char *line;                   // NUL-terminated copy for regexec
+    size_t line_cap;
+} FindScratch;
+
+static void wake_loop(void);
+
+
+static int find_push(FindHits *h, int line)
+{
+    if (h->n == h->cap)
+    {
+        int cap = h->cap ? h->cap * 2 : 64;
+        int *v = realloc(h->v, sizeof(int) * cap);
+        if (!v)
+            return -1;
+        h->v = v;
+        h->cap = cap;
+    }
+    h->v[h->n++] = line;
+    return 0;
+}
+
+static int find_lower_bound(const int *v, int n, int line)
+{
+    int lo = 0, hi = n;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (v[mid] < line)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static int find_match(const FindTask *task, FindScratch *sc, const char *s, int len)
+{
+    if (!task->regex)
+        return find_sub(s, len, task->query, task->qlen) != NULL;
+#ifdef REG_STARTEND
+    (void)sc; // only needed to NUL-terminate a copy
+    regmatch_t pm = {0, len};
+    return regexec(&task->re, s, 1, &pm, REG_STARTEND) == 0;
+#else
+    if ((size_t)len + 1 > sc->line_cap)
+    {
+        char *p = realloc(sc->line, len + 1);
+        if (!p)
+            return 0;
+        sc->line = p;
+        sc->line_cap = len + 1;
+    }
+    memcpy(sc->line, s, len);
+    sc->line[len] = '\0';
+    return regexec(&task->re, sc->line, 0, NULL, 0) == 0;
+#endif
+}
+
+// Search a buffer of '\n'-terminated lines, the first of which is line `first`
+static void find_in_buffer(const FindJob *job, FindScratch *sc, FindHits *out, int first,
+                           const char *buf, size_t len)
+{
+    const FindTask *task = job->task;
+    const char *p = buf, *end = buf + len;
+    int line = first;
+
+    if (!task->regex && first >= task->from)
+    {
+        // fast path: let the kernel skip straight to the next occurrence
+        while (p < end)
+        {
+            const char *hit = find_sub(p, end - p, task->query, task->qlen);
+            if (!hit)
+                return;
+            for (const char *nl; (nl = memchr(p, '\n', hit - p)) != NULL; p = nl + 1)
+                line++;
+            find_push(out, line);
+            const char *nl = memchr(hit, '\n', end - hit);
+            if (!nl)
+                return;
+            p = nl + 1;
+            line++;
+        }
+        return;
+    }
+
+    int k = task->cand ? find_lower_bound(task->cand, task->ncand, first) : 0;
+    while (p < end)
+    {
+        const char *nl = memchr(p, '\n', end - p);
+        int l = nl ? (int)(nl - p) : (int)(end - p);
+        int want = line >= task->from;
+        if (!want && task->cand)
+        {
+            while (k < task->ncand && task->cand[k] < line)
+                k++;
+            want = k < task->ncand && task->cand[k] == line;
+        }
+        if (want && find_match(task, sc, p, l))
+            find_push(out, line);
+        if (!nl)
+            break;
+        p = nl + 1;
+        line++;
+    }
+}
+
+static void find_unit(const FindJob *job, FindScratch *sc, const FindUnit *u, FindHits *out)
+{
+    switch (u->kind)
+    {
+    case FU_COLD:
+        find_in_buffer(job, sc, out, u->first, job->cold_map + u->off, u->end - u->off);
+        break;
+    case FU_WARM:
+    {
+        WarmBlock b = {(unsigned char *)u->data, u->len, u->rawlen, 0, u->nlines};
+        if (b.rawlen > sc->raw_cap)
+        {
+            char *p = realloc(sc->raw, b.rawlen);
+            if (!p)
+                return;
+            sc->raw = p;
+            sc->raw_cap = b.rawlen;
+        }
+        if (warm_inflate(&b, sc->raw) == 0)
+            find_in_buffer(job, sc, out, u->first, sc->raw, b.rawlen);
+        break;
+    }
+    default:
+        find_in_buffer(job, sc, out, u->first, u->data, u->len);
+    }
+}
+
+static void *find_worker(void *arg)
+{
+    FindJob *job = arg;
+    FindScratch sc = {0};
+    while (!__atomic_load_n(&job->task->cancel, __ATOMIC_RELAXED))
+    {
+        int u = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (u >= job->task->nunits)
+            break;
+        find_unit(job, &sc, &job->task->units[u], &job->res[u]);
+    }
+    free(sc.raw);
+    free(sc.line);
+    return NULL;
+}
+
+// Whether lines [first, first + n) need a look: new since the last search, or holding a previous hit
+static int find_wanted(const FindTask *task, int first, int n)
+{
+    if (first + n > task->from)
+        return 1;
+    int k = find_lower_bound(task->cand, task->ncand, first);
+    return k < task->ncand && task->cand[k] < first + n;
+}
+
+// Append u; unless it is FU_COLD, with u.len bytes of data for the caller to fill
+static FindUnit *find_add_unit(FindTask *task, int *cap, FindUnit u)
+{
+    if (task->nunits == *cap)
+    {
+        int c = *cap ? *cap * 2 : 256;
+        FindUnit *p = realloc(task->units, sizeof(FindUnit) * c);
+        if (!p)
+            return NULL;
+        task->units = p;
+        *cap = c;
+    }
+    if (u.kind != FU_COLD && !(u.data = malloc(u.len ? u.len : 1)))
+        return NULL;
+    task->units[task->nunits] = u;
+    return &task->units[task->nunits++];
+}
+
+/* Split the scrollback into the units task has to search, copying what
+   later output could move or free. Main thread, ui_lock held. */
+static int find_snapshot(TextBuffer *tb, FindTask *task)
+{
+    int cap = 0, line = 0;
+    SpillStore *sp = &tb->cold;
+    if (sp->count > 0)
+    {
+        int ngroups = (sp->count + SPILL_GROUP - 1) / SPILL_GROUP;
+        for (int g = 0; g < ngroups; g += FIND_COLD_GROUPS)
+        {
+            int g1 = g + FIND_COLD_GROUPS < ngroups ? g + FIND_COLD_GROUPS : ngroups;
+            int n = (g1 < ngroups ? g1 * SPILL_GROUP : sp->count) - line;
+            if (line + n > task->from)
             {
-                close(t->jobs[i].master_fd);
-                t->jobs[i].master_fd = -1;
+                unsigned long long end = g1 < ngroups ? sp->group_off[g1] : sp->size;
+                FindUnit u = {FU_COLD, line, n, sp->group_off[g], end, NULL, 0, 0};
+                if (!find_add_unit(task, &cap, u))
+                    return -1;
             }
-            char msg[256];
-            if (WIFEXITED(st))
+            else
             {
-                snprintf(msg, sizeof(msg), "[%d] Done (exit %d)  %s", t->jobs[i].pid, WEXITSTATUS(st), t->jobs[i].cmd);
+                // narrowing: only the groups that hold previous hits
+                for (int h = g; h < g1; h++)
+                {
+                    int first = h * SPILL_GROUP;
+                    int m = h + 1 < ngroups ? SPILL_GROUP : sp->count - first;
+                    unsigned long long end = h + 1 < ngroups ? sp->group_off[h + 1] : sp->size;
+                    FindUnit u = {FU_COLD, first, m, sp->group_off[h], end, NULL, 0, 0};
+                    if (find_wanted(task, first, m) && !find_add_unit(task, &cap, u))
+                        return -1;
+                }
             }
-            else if (WIFSIGNALED(st))
+            line += n;
+        }
+        if (task->nunits > 0)
+        {
+            fflush(sp->fp);
+            sp->flushed = sp->size;
+            task->cold_fd = fcntl(fileno(sp->fp), F_DUPFD_CLOEXEC, 0);
+            task->cold_size = sp->size;
+            if (task->cold_fd < 0)
+                return -1;
+        }
+    }
+
+    const WarmStore *w = &tb->warm;
+    for (int b = 0; b < w->nblocks; b++)
+    {
+        const WarmBlock *wb = &w->blocks[b];
+        if (find_wanted(task, line, wb->nlines))
+        {
+            FindUnit u = {FU_WARM, line, wb->nlines, 0, 0, NULL, wb->zlen, wb->rawlen};
+            FindUnit *p = find_add_unit(task, &cap, u);
+            if (!p)
+                return -1;
+            memcpy(p->data, wb->z, wb->zlen);
+        }
+        line += wb->nlines;
+    }
+    if (w->stage_lines > 0)
+    {
+        if (find_wanted(task, line, w->stage_lines))
+        {
+            FindUnit u = {FU_STAGE, line, w->stage_lines, 0, 0, NULL, w->stage_len, 0};
+            FindUnit *p = find_add_unit(task, &cap, u);
+            if (!p)
+                return -1;
+            memcpy(p->data, w->stage, w->stage_len);
+        }
+        line += w->stage_lines;
+    }
+
+    for (int i = 0; i < tb->line_count; i += FIND_UNIT_LINES)
+    {
+        int n = tb->line_count - i < FIND_UNIT_LINES ? tb->line_count - i : FIND_UNIT_LINES, l;
+        if (find_wanted(task, line, n))
+        {
+            FindUnit u = {FU_HOT, line, n, 0, 0, NULL, 0, 0};
+            for (int j = i; j < i + n; j++)
             {
-                snprintf(msg, sizeof(msg), "[%d] Terminated by signal %d  %s", t->jobs[i].pid, WTERMSIG(st), t->jobs[i].cmd);
+                tb_line(tb, j, &l);
+                u.len += l + 1;
             }
-            else
+            FindUnit *p = find_add_unit(task, &cap, u);
+            if (!p)
+                return -1;
+            char *d = p->data;
+            for (int j = i; j < i + n; j++)
             {
-                snprintf(msg, sizeof(msg), "[%d] Done  %s", t->jobs[i].pid, t->jobs[i].cmd);
+                const char *s = tb_line(tb, j, &l);
+                memcpy(d, s, l);
+                d[l] = '\n';
+                d += l + 1;
             }
-            tb_append(&t->tb, msg);
+        }
+        line += n;
+    }
+    return 0;
+}
+
+static void find_task_free(FindTask *task)
+{
+    for (int u = 0; u < task->nunits; u++)
+        free(task->units[u].data);
+    free(task->units);
+    free(task->cand);
+    free(task->hits);
+    if (task->regex)
+        regfree(&task->re);
+    if (task->cold_fd >= 0)
+        close(task->cold_fd);
+    free(task);
+}
+
+// Search the task's units; leaves the sorted hits in task->hits, or nhits = -1
+static void find_task_run(FindTask *task)
+{
+    char *cold_map = NULL;
+    task->nhits = -1;
+    if (task->cold_fd >= 0)
+    {
+        cold_map = mmap(NULL, task->cold_size, PROT_READ, MAP_SHARED, task->cold_fd, 0);
+        close(task->cold_fd);
+        task->cold_fd = -1;
+        if (cold_map == MAP_FAILED)
+            return;
+    }
+
+    int nunits = task->nunits;
+    FindJob job = {task, cold_map, calloc(nunits ? nunits : 1, sizeof(FindHits)), 0};
+    if (job.res)
+    {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        int nthreads = ncpu < 1 ? 1 : ncpu > FIND_MAX_THREADS ? FIND_MAX_THREADS : (int)ncpu;
+        if (nthreads > nunits)
+            nthreads = nunits;
+        pthread_t th[FIND_MAX_THREADS];
+        int started = 0;
+        for (int i = 1; i < nthreads; i++)
+            if (pthread_create(&th[started], NULL, find_worker, &job) == 0)
+                started++;
+        find_worker(&job); // this thread takes units too
+        for (int i = 0; i < started; i++)
+            pthread_join(th[i], NULL);
+
+        int total = 0;
+        for (int u = 0; u < nunits; u++)
+            total += job.res[u].n;
+        if (!__atomic_load_n(&task->cancel, __ATOMIC_RELAXED) &&
+            (task->hits = malloc(sizeof(int) * (total ? total : 1))) != NULL)
+        {
+            task->nhits = 0;
+            for (int u = 0; u < nunits; u++)
+            {
+                memcpy(task->hits + task->nhits, job.res[u].v, sizeof(int) * job.res[u].n);
+                task->nhits += job.res[u].n;
+            }
+        }
+    }
+    for (int u = 0; job.res && u < nunits; u++)
+        free(job.res[u].v);
+    free(job.res);
+    if (cold_map)
+        munmap(cold_map, task->cold_size);
+}
+
+static void *find_thread(void *arg)
+{
+    FindTask *task = arg;
+    find_task_run(task);
+    pthread_mutex_lock(&ui_lock);
+    task->next = find_done;
+    find_done = task;
+    pthread_mutex_unlock(&ui_lock);
+    wake_loop();
+    return NULL;
+}
+
+// Drop the search in flight; its thread still finishes and find_collect frees it
+static void find_cancel(FindState *fs)
+{
+    if (!fs->task)
+        return;
+    __atomic_store_n(&fs->task->cancel, 1, __ATOMIC_RELAXED);
+    fs->task = NULL;
+}
+
+static void find_clear(FindState *fs)
+{
+    find_cancel(fs);
+    free(fs->hits);
+    fs->hits = NULL;
+    fs->nhits = 0;
+    fs->cur = -1;
+    fs->scanned = 0;
+    fs->searched[0] = '\0';
+    fs->gen++;
+}
+
+static void find_free(FindState *fs)
+{
+    find_clear(fs);
+    if (fs->re_ok)
+        regfree(&fs->re);
+    fs->re_ok = 0;
+}
+
+// Take over a finished task's hits
+static void find_apply(FindState *fs, FindTask *task)
+{
+    fs->task = NULL;
+    if (task->nhits < 0)
+        return;
+    int same = fs->searched_regex == task->regex && strcmp(fs->searched, task->query) == 0;
+    if (task->keep > 0)
+    {
+        int *all = realloc(fs->hits, sizeof(int) * (task->keep + task->nhits + 1));
+        if (!all)
+            return;
+        memcpy(all + task->keep, task->hits, sizeof(int) * task->nhits);
+        fs->hits = all;
+        fs->nhits = task->keep + task->nhits;
+    }
+    else
+    {
+        free(fs->hits);
+        fs->hits = task->hits;
+        fs->nhits = task->nhits;
+        task->hits = NULL;
+    }
+    if (!same)
+    {
+        fs->cur = fs->nhits - 1; // start from the newest hit
+        fs->reveal = 1;
+    }
+    else if (fs->cur >= fs->nhits)
+        fs->cur = fs->nhits - 1;
+    strcpy(fs->searched, task->query);
+    fs->searched_regex = task->regex;
+    fs->scanned = task->scanned;
+    fs->gen++;
+}
+
+/* Bring the hit list up to date with the query and the buffer:
+   - same query: keep the hits, search only lines added since;
+   - literal query that contains the previous one: re-check the previous hits
+     only, plus the new lines;
+   - anything else: search everything.
+   Anything left to scan goes to a background task; the hits change when
+   find_collect applies it. */
+static void find_run(Tab *t)
+{
+    FindState *fs = &t->find;
+    TextBuffer *tb = &t->tb;
+    int total = tb_total_lines(tb);
+    if (fs->qlen == 0)
+    {
+        find_clear(fs);
+        fs->bad_regex = 0;
+        return;
+    }
+
+    int same = fs->searched_regex == fs->regex && strcmp(fs->searched, fs->query) == 0;
+    if (!same && fs->regex)
+    {
+        if (fs->re_ok)
+            regfree(&fs->re);
+        fs->re_ok = regcomp(&fs->re, fs->query, REG_EXTENDED) == 0;
+        fs->bad_regex = !fs->re_ok;
+        if (!fs->re_ok)
+        {
+            find_clear(fs);
+            return;
+        }
+    }
+    fs->bad_regex = 0;
+
+    find_cancel(fs);
+    FindTask *task = calloc(1, sizeof(*task));
+    if (!task)
+        return;
+    task->cold_fd = -1;
+    if (fs->regex && regcomp(&task->re, fs->query, REG_EXTENDED) != 0)
+    {
+        free(task);
+        return;
+    }
+    strcpy(task->query, fs->query);
+    task->qlen = fs->qlen;
+    task->regex = fs->regex;
+    task->scanned = total - tb->open_line; // the open line may still grow
+
+    if (fs->searched[0] && fs->scanned <= total)
+    {
+        if (same)
+        {
+            task->from = fs->scanned;
+            task->keep = find_lower_bound(fs->hits, fs->nhits, task->from);
+        }
+        else if (!fs->regex && !fs->searched_regex && strstr(fs->query, fs->searched))
+        {
+            task->from = fs->scanned;
+            task->cand = malloc(sizeof(int) * (fs->nhits ? fs->nhits : 1));
+            if (!task->cand)
+            {
+                find_task_free(task);
+                return;
+            }
+            memcpy(task->cand, fs->hits, sizeof(int) * fs->nhits);
+            task->ncand = fs->nhits;
+        }
+    }
+
+    find_sub_init();
+    if (find_snapshot(tb, task) < 0)
+    {
+        find_task_free(task);
+        return;
+    }
+    fs->task = task;
+    fs->gen++;
+    pthread_t th;
+    if (task->nunits > 0 && pthread_create(&th, NULL, find_thread, task) == 0)
+        pthread_detach(th);
+    else
+    {
+        find_task_run(task); // nothing new to scan, or no thread to spare
+        find_apply(fs, task);
+        find_task_free(task);
+    }
+}
+
+// Scroll so the selected hit sits mid-screen
+static void find_show(Tab *t, int rows)
+{
+    FindState *fs = &t->find;
+    if (fs->cur < 0 || fs->cur >= fs->nhits)
+        return;
+    int start = fs->hits[fs->cur] - rows / 2;
+    if (start < 0)
+        start = 0;
+    t->scroll_offset = tb_total_lines(&t->tb) - rows - start;
+    if (t->scroll_offset < 0)
+        t->scroll_offset = 0;
+}
+
+// Show the newest hit of a query once its results are in
+static void find_reveal(Tab *t, int rows)
+{
+    if (!t->find.reveal)
+        return;
+    t->find.reveal = 0;
+    find_show(t, rows);
+}
+
+// Main loop: apply finished searches that are still their tab's latest, free the rest
+static void find_collect(Tab *tabs, int tab_count, int rows)
+{
+    while (find_done)
+    {
+        FindTask *task = find_done;
+        find_done = task->next;
+        for (int i = 0; i < tab_count; i++)
+            if (tabs[i].find.task == task)
+            {
+                find_apply(&tabs[i].find, task);
+                find_reveal(&tabs[i], rows);
+                ui_needs_redraw = 1;
+            }
+        find_task_free(task);
+    }
+}
+
+/* Keys while Ctrl+F is active. Returns 0 for keys it leaves to the normal
+   handler (paging, Ctrl+C, ...). */
+static int find_key(Tab *t, KeySym ks, unsigned char c, int rows)
+{
+    FindState *fs = &t->find;
+    if (!fs->active)
+    {
+        if (c != 6)
+            return 0;
+        fs->active = 1;
+        fs->qlen = 0;
+        fs->query[0] = '\0';
+        find_clear(fs);
+        return 1;
+    }
+
+    if (c == 27 || ks == XK_Escape)
+    {
+        fs->active = 0;
+        fs->gen++;
+        return 1;
+    }
+    if (c == 6 || c == '\r' || c == '\n' || ks == XK_Up || ks == XK_Down)
+    {
+        find_run(t); // picks up output that arrived since the last search
+        int step = ks == XK_Down ? 1 : -1;
+        if (fs->cur + step >= 0 && fs->cur + step < fs->nhits)
+            fs->cur += step;
+        fs->gen++;
+        find_show(t, rows);
+        return 1;
+    }
+    if (ks == XK_Tab)
+        fs->regex = !fs->regex;
+    else if (c == 127 || ks == XK_BackSpace)
+    {
+        if (fs->qlen == 0)
+            return 1;
+        fs->query[--fs->qlen] = '\0';
+    }
+    else if ((c >= 0x20 && c != 127) && fs->qlen + 1 < (int)sizeof(fs->query))
+    {
+        fs->query[fs->qlen++] = c;
+        fs->query[fs->qlen] = '\0';
+    }
+    else
+        return 0;
+    find_run(t);
+    find_reveal(t, rows);
+    return 1;
+}
+
+// ===== Persistent Command History =====
+/* History lookups go through an index kept in step with shared_hist.items:
+   - a trigram table mapping every 3-byte sequence to the ascending ids of
+     the entries containing it (substring queries intersect the two rarest
+     lists of the term and verify the survivors),
+   - an open-addressing table of the newest id for each distinct entry,
+   - the ids sorted by text, for prefix ranges.
+   Ids are absolute: entry id lives at items[id - base], and dropping the
+   oldest entry only raises base, so stale ids form a prefix of every posting
+   list and are skipped by binary search until the next rebuild. */
+static const char *hidx_text(const HistIndex *hx, int id)
+{
+    return hx->hist[id - hx->base];
+}
+
+static unsigned int hidx_hash(const char *s, size_t n)
+{
+    unsigned int h = 2166136261u;
+    for (size_t i = 0; i < n; i++)
+        h = (h ^ (unsigned char)s[i]) * 16777619u;
+    return h;
+}
+
+static HistPosting *hidx_posting(HistIndex *hx, unsigned int tri, int create)
+{
+    if (create && (hx->tri_used + 1) * 2 > hx->tri_cap)
+    {
+        int cap = hx->tri_cap ? hx->tri_cap * 2 : 4096;
+        HistPosting *t = calloc(cap, sizeof(HistPosting));
+        if (!t)
+            return NULL;
+        for (int i = 0; i < hx->tri_cap; i++)
+            if (hx->tri[i].key)
+            {
+                unsigned int j = (hx->tri[i].key * 2654435761u) & (cap - 1);
+                while (t[j].key)
+                    j = (j + 1) & (cap - 1);
+                t[j] = hx->tri[i];
+            }
+        free(hx->tri);
+        hx->tri = t;
+        hx->tri_cap = cap;
+    }
+    if (!hx->tri_cap)
+        return NULL;
+    unsigned int key = tri + 1, j = (key * 2654435761u) & (hx->tri_cap - 1);
+    while (hx->tri[j].key && hx->tri[j].key != key)
+        j = (j + 1) & (hx->tri_cap - 1);
+    if (!hx->tri[j].key)
+    {
+        if (!create)
+            return NULL;
+        hx->tri[j].key = key;
+        hx->tri_used++;
+    }
+    return &hx->tri[j];
+}
+
+static void hidx_exact_put(HistIndex *hx, const char *s, int id)
+{
+    if ((hx->exact_used + 1) * 2 > hx->exact_cap)
+    {
+        int cap = hx->exact_cap ? hx->exact_cap * 2 : 1024;
+        int *t = calloc(cap, sizeof(int));
+        if (!t)
+            return;
+        for (int i = 0; i < hx->exact_cap; i++)
+            if (hx->exact[i] && hx->exact[i] - 1 >= hx->base)
+            {
+                const char *e = hidx_text(hx, hx->exact[i] - 1);
+                unsigned int j = hidx_hash(e, strlen(e)) & (cap - 1);
+                while (t[j])
+                    j = (j + 1) & (cap - 1);
+                t[j] = hx->exact[i];
+            }
+        free(hx->exact);
+        hx->exact = t;
+        hx->exact_cap = cap;
+        hx->exact_used = 0;
+        for (int i = 0; i < cap; i++)
+            hx->exact_used += t[i] != 0;
+    }
+    unsigned int j = hidx_hash(s, strlen(s)) & (hx->exact_cap - 1);
+    while (hx->exact[j] && (hx->exact[j] - 1 < hx->base || strcmp(hidx_text(hx, hx->exact[j] - 1), s) != 0))
+        j = (j + 1) & (hx->exact_cap - 1);
+    if (!hx->exact[j])
+        hx->exact_used++;
+    hx->exact[j] = id + 1;
+}
+
+// First position in sorted whose text is >= s (ties: ids below id first)
+static int hidx_sorted_pos(const HistIndex *hx, const char *s, int id)
+{
+    int lo = 0, hi = hx->nsorted;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2, c = strcmp(hidx_text(hx, hx->sorted[mid]), s);
+        if (c < 0 || (c == 0 && hx->sorted[mid] < id))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Index hist[id - base]; called right after the entry is stored
+static void hidx_add_terms(HistIndex *hx, int id)
+{
+    const char *s = hidx_text(hx, id);
+    size_t n = strlen(s);
+    for (size_t i = 0; i + 3 <= n; i++)
+    {
+        unsigned int tri = (unsigned char)s[i] << 16 | (unsigned char)s[i + 1] << 8 | (unsigned char)s[i + 2];
+        HistPosting *p = hidx_posting(hx, tri, 1);
+        if (!p || (p->n > 0 && p->ids[p->n - 1] == id))
+            continue;
+        if (p->n == p->cap)
+        {
+            int cap = p->cap ? p->cap * 2 : 4;
+            int *ids = realloc(p->ids, sizeof(int) * cap);
+            if (!ids)
+                continue;
+            p->ids = ids;
+            p->cap = cap;
+        }
+        p->ids[p->n++] = id;
+    }
+    hidx_exact_put(hx, s, id);
+}
+
+// Refresh the max tree after sorted[from..to) changed
+static void hidx_tree_fix(HistIndex *hx, int from, int to)
+{
+    if (hx->nsorted > hx->tree_leaves)
+    {
+        int leaves = 1024;
+        while (leaves < hx->nsorted || leaves < hx->sorted_cap)
+            leaves *= 2;
+        int *t = realloc(hx->maxtree, sizeof(int) * 2 * leaves);
+        if (!t)
+        {
+            free(hx->maxtree);
+            hx->maxtree = NULL;
+            hx->tree_leaves = 0;
+            return;
+        }
+        hx->maxtree = t;
+        hx->tree_leaves = leaves;
+        from = 0;
+        to = leaves;
+    }
+    if (from >= to)
+        return;
+    int leaves = hx->tree_leaves, *t = hx->maxtree;
+    for (int i = from; i < to; i++)
+        t[leaves + i] = i < hx->nsorted ? hx->sorted[i] : -1;
+    for (int l = (leaves + from) / 2, r = (leaves + to - 1) / 2; l >= 1; l /= 2, r /= 2)
+        for (int j = l; j <= r; j++)
+            t[j] = t[2 * j] > t[2 * j + 1] ? t[2 * j] : t[2 * j + 1];
+}
+
+static void hidx_add(HistIndex *hx, int id)
+{
+    hidx_add_terms(hx, id);
+    const char *s = hidx_text(hx, id);
+    if (hx->nsorted == hx->sorted_cap)
+    {
+        int cap = hx->sorted_cap ? hx->sorted_cap * 2 : 1024;
+        int *v = realloc(hx->sorted, sizeof(int) * cap);
+        if (!v)
+            return;
+        hx->sorted = v;
+        hx->sorted_cap = cap;
+    }
+    int pos = hidx_sorted_pos(hx, s, id);
+    memmove(hx->sorted + pos + 1, hx->sorted + pos, sizeof(int) * (hx->nsorted - pos));
+    hx->sorted[pos] = id;
+    hx->nsorted++;
+    hidx_tree_fix(hx, pos, hx->nsorted);
+}
+
+static void hidx_free(HistIndex *hx)
+{
+    for (int i = 0; i < hx->tri_cap; i++)
+        free(hx->tri[i].ids);
+    free(hx->tri);
+    free(hx->exact);
+    free(hx->sorted);
+    free(hx->maxtree);
+    hx->tri = NULL;
+    hx->exact = NULL;
+    hx->sorted = NULL;
+    hx->maxtree = NULL;
+    hx->tri_cap = hx->tri_used = hx->exact_cap = hx->exact_used = 0;
+    hx->nsorted = hx->sorted_cap = hx->tree_leaves = 0;
+}
+
+static const HistIndex *sort_hx; // qsort has no portable context argument
+
+static int hidx_cmp(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+    int c = strcmp(hidx_text(sort_hx, x), hidx_text(sort_hx, y));
+    return c ? c : (x > y) - (x < y);
+}
+
+// (Re)build the index over hist[0..count) with ids starting at base
+static void hidx_build(HistIndex *hx, char **hist, int count, int base)
+{
+    hidx_free(hx);
+    hx->hist = hist;
+    hx->base = base;
+    hx->built_base = base;
+    hx->next = base + count;
+    for (int i = 0; i < count; i++)
+        hidx_add_terms(hx, base + i);
+    hx->sorted = malloc(sizeof(int) * (count ? count : 1));
+    if (!hx->sorted)
+        return;
+    hx->sorted_cap = count ? count : 1;
+    for (int i = 0; i < count; i++)
+        hx->sorted[i] = base + i;
+    hx->nsorted = count;
+    static pthread_mutex_t sort_lock = PTHREAD_MUTEX_INITIALIZER; // the history loader builds too
+    pthread_mutex_lock(&sort_lock);
+    sort_hx = hx;
+    qsort(hx->sorted, count, sizeof(int), hidx_cmp);
+    pthread_mutex_unlock(&sort_lock);
+    hidx_tree_fix(hx, 0, count);
+}
+
+// Forget the oldest entry; call before it is freed and shifted out
+static void hidx_drop_oldest(HistIndex *hx)
+{
+    int id = hx->base;
+    int pos = hidx_sorted_pos(hx, hidx_text(hx, id), id);
+    if (pos < hx->nsorted && hx->sorted[pos] == id)
+    {
+        memmove(hx->sorted + pos, hx->sorted + pos + 1, sizeof(int) * (hx->nsorted - pos - 1));
+        hx->nsorted--;
+        hidx_tree_fix(hx, pos, hx->nsorted + 1);
+    }
+    hx->base++;
+}
+
+/* Index the entry just stored at hist[count - 1]. Once as many entries have
+   been dropped as the history holds, the index is rebuilt to shed the stale
+   ids. */
+static void hidx_append(HistIndex *hx, int count)
+{
+    if (hx->base - hx->built_base >= MAX_HISTORY)
+        hidx_build(hx, hx->hist, count, hx->base);
+    else
+        hidx_add(hx, hx->next++);
+}
+
+static int hidx_live_from(const HistIndex *hx, const HistPosting *p)
+{
+    int lo = 0, hi = p->n;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (p->ids[mid] < hx->base)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Newest entries containing sub[0..n), newest first, at most max; returns
+   how many were stored in out. */
+static int hidx_contains(HistIndex *hx, const char *sub, int n, int *out, int max)
+{
+    int found = 0;
+    find_sub_init();
+    if (n < 3)
+    {
+        // too short for trigrams: scan backwards, usually a few entries deep
+        for (int id = hx->next - 1; id >= hx->base && found < max; id--)
+        {
+            const char *e = hidx_text(hx, id);
+            if (find_sub(e, strlen(e), sub, n))
+                out[found++] = id;
+        }
+        return found;
+    }
+
+    // the two rarest trigrams of sub: walk the first, probe the second
+    const HistPosting *r1 = NULL, *r2 = NULL;
+    int n1 = 0, n2 = 0;
+    for (int i = 0; i + 3 <= n; i++)
+    {
+        unsigned int tri = (unsigned char)sub[i] << 16 | (unsigned char)sub[i + 1] << 8 | (unsigned char)sub[i + 2];
+        const HistPosting *p = hidx_posting(hx, tri, 0);
+        int live = p ? p->n - hidx_live_from(hx, p) : 0;
+        if (live == 0)
+            return 0;
+        if (!r1 || live < n1)
+        {
+            r2 = r1;
+            n2 = n1;
+            r1 = p;
+            n1 = live;
+        }
+        else if (p != r1 && (!r2 || live < n2))
+        {
+            r2 = p;
+            n2 = live;
+        }
+    }
+    int lo2 = r2 ? hidx_live_from(hx, r2) : 0;
+    for (int k = r1->n - 1; k >= r1->n - n1 && found < max; k--)
+    {
+        int id = r1->ids[k];
+        if (r2)
+        {
+            int lo = lo2, hi = r2->n;
+            while (lo < hi)
+            {
+                int mid = (lo + hi) / 2;
+                if (r2->ids[mid] < id)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            if (lo == r2->n || r2->ids[lo] != id)
+                continue;
+        }
+        const char *e = hidx_text(hx, id);
+        if (find_sub(e, strlen(e), sub, n))
+            out[found++] = id;
+    }
+    return found;
+}
+
+static int hidx_exact(const HistIndex *hx, const char *s)
+{
+    if (!hx->exact_cap)
+        return -1;
+    unsigned int j = hidx_hash(s, strlen(s)) & (hx->exact_cap - 1);
+    for (; hx->exact[j]; j = (j + 1) & (hx->exact_cap - 1))
+        if (hx->exact[j] - 1 >= hx->base && strcmp(hidx_text(hx, hx->exact[j] - 1), s) == 0)
+            return hx->exact[j] - 1;
+    return -1;
+}
+
+// First position in sorted whose text compares above prefix[0..n) (or at it, if !past)
+static int hidx_prefix_bound(const HistIndex *hx, const char *prefix, int n, int lo, int past)
+{
+    int hi = hx->nsorted;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        int c = strncmp(hidx_text(hx, hx->sorted[mid]), prefix, n);
+        if (c < 0 || (past && c == 0))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Newest entry starting with prefix[0..n), or -1. The matches form the range
+   [lo, hi) of sorted; its max id comes from the segment tree. */
+static int hidx_prefix(const HistIndex *hx, const char *prefix, int n)
+{
+    int lo = hidx_prefix_bound(hx, prefix, n, 0, 0);
+    int hi = hidx_prefix_bound(hx, prefix, n, lo, 1);
+    int best = -1;
+    if (!hx->maxtree)
+    {
+        for (int i = lo; i < hi; i++)
+            if (hx->sorted[i] > best)
+                best = hx->sorted[i];
+        return best;
+    }
+    const int *t = hx->maxtree;
+    for (int l = lo + hx->tree_leaves, r = hi + hx->tree_leaves; l < r; l /= 2, r /= 2)
+    {
+        if (l & 1 && t[l++] > best)
+            best = t[l - 1];
+        if (r & 1 && t[--r] > best)
+            best = t[r];
+    }
+    return best;
+}
+
+/* Longest substring of term (at least 3 bytes) found in any entry. Having a
+   match of length L implies one of every shorter length, so L is found by
+   binary search. Fills out with up to max entries (newest first) holding a
+   longest match and returns its length, or 0. */
+static int hidx_longest(HistIndex *hx, const char *term, int *out, int max, int *nout)
+{
+    int tlen = strlen(term), lo = 2, hi = tlen, probe;
+    *nout = 0;
+    while (lo < hi)
+    {
+        int mid = (lo + hi + 1) / 2, ok = 0;
+        for (int j = 0; j + mid <= tlen && !ok; j++)
+            ok = hidx_contains(hx, term + j, mid, &probe, 1);
+        if (ok)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    if (lo < 3)
+        return 0;
+    for (int j = 0; j + lo <= tlen && *nout < max; j++)
+    {
+        int got[20];
+        int n = hidx_contains(hx, term + j, lo, got, max < 20 ? max : 20);
+        for (int i = 0; i < n && *nout < max; i++)
+        {
+            int dup = 0;
+            for (int k = 0; k < *nout; k++)
+                dup |= out[k] == got[i];
+            if (!dup)
+                out[(*nout)++] = got[i];
+        }
+    }
+    return lo;
+}
+
+/* Interned history text. The refcount sits just before the string, so
+   items[] and the index keep plain char pointers. Entries loaded from the
+   file point into shared_hist.map instead and are not counted. */
+typedef struct
+{
+    int refs;
+    char s[];
+} HistText;
+
+static HistText *hist_text_of(const char *s)
+{
+    return (HistText *)(s - offsetof(HistText, s));
+}
+
+static char *hist_new_text(const char *s)
+{
+    size_t n = strlen(s) + 1;
+    HistText *h = malloc(sizeof(*h) + n);
+    if (!h)
+        return NULL;
+    h->refs = 1;
+    memcpy(h->s, s, n);
+    return h->s;
+}
+
+static int hist_mapped(const char *s)
+{
+    return s >= shared_hist.map && s < shared_hist.map + shared_hist.map_len;
+}
+
+// Text for a new entry: a reference to an existing copy when there is one
+static char *hist_intern(const char *s)
+{
+    int id = hidx_exact(&shared_hist.hidx, s);
+    if (id < 0)
+        return hist_new_text(s);
+    char *e = shared_hist.items[id - shared_hist.hidx.base];
+    if (!hist_mapped(e))
+        hist_text_of(e)->refs++;
+    return e;
+}
+
+static void hist_release(char *s)
+{
+    if (s && !hist_mapped(s) && --hist_text_of(s)->refs == 0)
+        free(hist_text_of(s));
+}
+
+// Append entry text s (already interned) for tab sess, dropping the oldest when full
+static void hist_push(char *s, int sess)
+{
+    HistStore *hs = &shared_hist;
+    if (hs->count == MAX_HISTORY)
+    {
+        hidx_drop_oldest(&hs->hidx);
+        hist_release(hs->items[0]);
+        memmove(&hs->items[0], &hs->items[1], sizeof(char *) * (MAX_HISTORY - 1));
+        memmove(&hs->sess[0], &hs->sess[1], sizeof(int) * (MAX_HISTORY - 1));
+        hs->count--;
+    }
+    hs->items[hs->count] = s;
+    hs->sess[hs->count++] = sess;
+    hidx_append(&hs->hidx, hs->count);
+}
+
+// Append a command run in tab sess
+static void hist_add(int sess, const char *text)
+{
+    char *s = hist_intern(text);
+    if (s)
+        hist_push(s, sess);
+}
+
+static void history_path(char *path, size_t n)
+{
+    snprintf(path, n, "%s/%s", getenv("HOME"), HISTORY_FILE);
+}
+
+/* History loading runs on a thread so the first frame never waits for the
+   file. The thread maps the file privately and walks it backwards from the
+   end, so only the newest MAX_HISTORY lines are parsed: each '\n' becomes
+   a NUL in place and the entry points straight into the mapping (only the
+   touched pages are copied). It then builds the index for them. The main
+   loop merges the result in when it is done; anything that reads history
+   before then (Up/Down, `history`, Ctrl+R) waits for it in hist_wait. */
+typedef struct
+{
+    pthread_t thread;
+    int running;  // started and not merged yet
+    int threaded; // running on its own thread (else it already ran inline)
+    int done;     // results ready; set by the loader
+    int announce; // merged from the file; hist_poll has yet to tell the tabs
+    char *map;
+    size_t map_len;
+    char **items;
+    int count, lines;
+    HistIndex hidx;
+} HistLoader;
+
+static HistLoader loader;
+
+
+static void *hist_load_thread(void *arg)
+{
+    (void)arg;
+    char path[PATH_MAX];
+    history_path(path, sizeof(path));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    char *map = MAP_FAILED;
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0)
+        map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (fd >= 0)
+        close(fd);
+    if (map != MAP_FAILED && !(loader.items = malloc(sizeof(char *) * MAX_HISTORY)))
+    {
+        munmap(map, st.st_size);
+        map = MAP_FAILED;
+    }
+    if (map != MAP_FAILED)
+    {
+        size_t len = st.st_size, end = len;
+        if (map[len - 1] == '\n')
+            end = len - 1; // end is the terminator of the line being read
+        int slot = MAX_HISTORY;
+        for (;;)
+        {
+            size_t start = end;
+            while (start > 0 && map[start - 1] != '\n')
+                start--;
+            if (end > start)
+            {
+                loader.lines++;
+                if (slot > 0 && end < len)
+                {
+                    map[end] = '\0';
+                    loader.items[--slot] = map + start;
+                }
+                else if (slot > 0)
+                {
+                    // the last line has no newline to overwrite
+                    char *line = strndup(map + start, end - start);
+                    if (line && (loader.items[slot - 1] = hist_new_text(line)))
+                        slot--;
+                    free(line);
+                }
+            }
+            if (start == 0)
+                break;
+            end = start - 1;
+        }
+        loader.count = MAX_HISTORY - slot;
+        memmove(loader.items, loader.items + slot, sizeof(char *) * loader.count);
+        loader.map = map;
+        loader.map_len = len;
+        hidx_build(&loader.hidx, loader.items, loader.count, 0);
+    }
+    __atomic_store_n(&loader.done, 1, __ATOMIC_RELEASE);
+    wake_loop();
+    return NULL;
+}
+
+// Install the loaded entries ahead of the commands run while loading
+static void hist_merge(void)
+{
+    HistStore *hs = &shared_hist;
+    if (loader.threaded)
+        pthread_join(loader.thread, NULL);
+    loader.running = 0;
+    if (!loader.items)
+        return;
+    int n = hs->count;
+    char **run = malloc(sizeof(char *) * (n + 1));
+    int *run_sess = malloc(sizeof(int) * (n + 1));
+    if (!run || !run_sess)
+    {
+        free(run);
+        free(run_sess);
+        hidx_free(&loader.hidx);
+        free(loader.items);
+        munmap(loader.map, loader.map_len);
+        return;
+    }
+    memcpy(run, hs->items, sizeof(char *) * n);
+    memcpy(run_sess, hs->sess, sizeof(int) * n);
+    hidx_free(&hs->hidx);
+    hs->map = loader.map;
+    hs->map_len = loader.map_len;
+    memcpy(hs->items, loader.items, sizeof(char *) * loader.count);
+    memset(hs->sess, 0, sizeof(int) * loader.count);
+    hs->count = loader.count;
+    hs->hidx = loader.hidx;
+    hs->hidx.hist = hs->items;
+    hs->from_file = 1;
+    loader.announce = 1;
+    free(loader.items);
+    loader.items = NULL;
+    for (int i = 0; i < n; i++)
+        hist_push(run[i], run_sess[i]);
+    free(run);
+    free(run_sess);
+}
+
+// Make sure the file's entries are in the store before reading it
+static void hist_wait(void)
+{
+    if (loader.running)
+        hist_merge();
+}
+
+/* Main loop: merge once the loader has finished, without waiting for it,
+   and tell the open tabs (also when hist_wait did the merge) */
+static void hist_poll(Tab *tabs, int tab_count)
+{
+    if (loader.running && __atomic_load_n(&loader.done, __ATOMIC_ACQUIRE))
+        hist_merge();
+    if (!loader.announce)
+        return;
+    loader.announce = 0;
+    for (int i = 0; i < tab_count; i++)
+    {
+        tb_append(&tabs[i].tb, "Command history loaded from ~/.myterm_history");
+        ui_needs_redraw = 1;
+    }
+}
+
+// The first tab starts the loader; later tabs share the store
+static void load_history(Tab *t)
+{
+    if (!shared_hist.loaded)
+    {
+        shared_hist.loaded = 1;
+        loader.running = 1;
+        loader.threaded = pthread_create(&loader.thread, NULL, hist_load_thread, NULL) == 0;
+        if (!loader.threaded)
+            hist_load_thread(NULL);
+    }
+    if (shared_hist.from_file && !loader.announce) // else hist_poll tells this tab too
+        tb_append(&t->tb, "Command history loaded from ~/.myterm_history");
+}
+
+// Whether entry id belongs to t's view: shared from the file, or run in t
+static int hist_visible(const Tab *t, int id)
+{
+    int sess = shared_hist.sess[id - shared_hist.hidx.base];
+    return sess == 0 || sess == t->id;
+}
+
+/* Next entry of t's view from its Up/Down cursor, dir -1 = older, +1 =
+   newer. Returns the id, or -1 past either end. */
+static int hist_step(const Tab *t, int dir)
+{
+    hist_wait();
+    int base = shared_hist.hidx.base, end = base + shared_hist.count;
+    int id = t->hist_index;
+    if (id < 0)
+    {
+        if (dir > 0)
+            return -1;
+        id = end;
+    }
+    if (id < base - 1)
+        id = base - 1; // the cursor's entry has rotated out
+    for (id += dir; id >= base && id < end; id += dir)
+        if (hist_visible(t, id))
+            return id;
+    return -1;
+}
+
+/* History journal. The history file is append-only: run_command only
+   queues the line, and a writer thread appends each batch with a single
+   O_APPEND write, fsyncs at most once a second, and once the file has
+   grown to twice MAX_HISTORY lines rewrites it with the newest MAX_HISTORY
+   (temp file + rename). Writers take a shared flock and compaction an
+   exclusive one, and a writer whose file was renamed over reopens it, so
+   several MyTerm instances can share the file. */
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+    int started, quit;
+    char *buf; // queued lines, '\n'-terminated
+    size_t len, cap;
+} HistJournal;
+
+static HistJournal journal = {.lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER};
+
+/* Lock the journal file with op (LOCK_SH / LOCK_EX), first (re)opening *fd
+   if it is closed or no longer the file at path. Returns 0 when locked. */
+static int journal_lock(int *fd, const char *path, int op)
+{
+    for (int tries = 0; tries < 3; tries++)
+    {
+        if (*fd < 0)
+            *fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+        if (*fd < 0)
+            return -1;
+        if (flock(*fd, op) < 0)
+            return -1;
+        struct stat a, b;
+        if (fstat(*fd, &a) == 0 && stat(path, &b) == 0 && a.st_ino == b.st_ino && a.st_dev == b.st_dev)
+            return 0;
+        // compacted (or removed) by someone else since we opened it
+        flock(*fd, LOCK_UN);
+        close(*fd);
+        *fd = -1;
+    }
+    return -1;
+}
+
+static void journal_write(int *fd, const char *path, const char *p, size_t n)
+{
+    if (journal_lock(fd, path, LOCK_SH) < 0)
+        return;
+    while (n > 0)
+    {
+        ssize_t w = write(*fd, p, n);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            break;
+        p += w;
+        n -= w;
+    }
+    flock(*fd, LOCK_UN);
+}
+
+// Rewrite the file with its newest MAX_HISTORY lines; returns the line count
+static int journal_compact(int *fd, const char *path)
+{
+    char tmp[PATH_MAX + 16];
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+    if (journal_lock(fd, path, LOCK_EX) < 0)
+        return -1;
+    int kept = -1;
+    FILE *in = fopen(path, "r");
+    FILE *out = in ? fopen(tmp, "w") : NULL;
+    if (out)
+    {
+        char *line = NULL;
+        size_t cap = 0;
+        int total = 0;
+        while (getline(&line, &cap, in) > 0)
+            total++;
+        rewind(in);
+        kept = 0;
+        for (int i = 0; getline(&line, &cap, in) > 0; i++)
+            if (i >= total - MAX_HISTORY)
+            {
+                fputs(line, out);
+                kept++;
+            }
+        free(line);
+        if (fflush(out) == 0 && fsync(fileno(out)) == 0 && fclose(out) == 0)
+            out = NULL;
+        if (out || rename(tmp, path) < 0)
+        {
+            kept = -1;
+            unlink(tmp);
+        }
+    }
+    if (out)
+        fclose(out);
+    if (in)
+        fclose(in);
+    // our fd now names the old file; the next write reopens
+    flock(*fd, LOCK_UN);
+    close(*fd);
+    *fd = -1;
+    return kept;
+}
+
+static void *journal_thread(void *arg)
+{
+    (void)arg;
+    // lines we wrote, plus the file's own once the loader has counted them
+    int lines = 0, counted = 0;
+    char path[PATH_MAX];
+    history_path(path, sizeof(path));
+    int fd = -1, dirty = 0;
+    struct timespec sync_at = {0};
+
+    pthread_mutex_lock(&journal.lock);
+    for (;;)
+    {
+        while (!journal.len && !journal.quit)
+        {
+            if (!dirty)
+                pthread_cond_wait(&journal.cond, &journal.lock);
+            else if (pthread_cond_timedwait(&journal.cond, &journal.lock, &sync_at) == ETIMEDOUT)
+                break;
+        }
+        char *batch = journal.buf;
+        size_t n = journal.len;
+        int quit = journal.quit;
+        journal.buf = NULL;
+        journal.len = journal.cap = 0;
+        pthread_mutex_unlock(&journal.lock);
+
+        if (n)
+        {
+            journal_write(&fd, path, batch, n);
+            for (size_t i = 0; i < n; i++)
+                lines += batch[i] == '\n';
+            free(batch);
+            if (!dirty)
+            {
+                clock_gettime(CLOCK_REALTIME, &sync_at);
+                sync_at.tv_sec++;
+                dirty = 1;
+            }
+        }
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        if (dirty && (quit || now.tv_sec > sync_at.tv_sec ||
+                      (now.tv_sec == sync_at.tv_sec && now.tv_nsec >= sync_at.tv_nsec)))
+        {
+            if (fd >= 0)
+                fsync(fd);
+            dirty = 0;
+        }
+        if (!counted && __atomic_load_n(&loader.done, __ATOMIC_ACQUIRE))
+        {
+            lines += loader.lines;
+            counted = 1;
+        }
+        if (counted && lines >= 2 * MAX_HISTORY && !dirty)
+        {
+            int kept = journal_compact(&fd, path);
+            lines = kept >= 0 ? kept : 0; // on failure, retry after another full round
+        }
+
+        pthread_mutex_lock(&journal.lock);
+        if (quit && !journal.len)
+            break;
+    }
+    pthread_mutex_unlock(&journal.lock);
+    if (fd >= 0)
+        close(fd);
+    return NULL;
+}
+
+// Queue a command for the journal; never waits for the disk
+static void journal_append(const char *cmd)
+{
+    size_t n = strlen(cmd);
+    pthread_mutex_lock(&journal.lock);
+    if (journal.len + n + 1 > journal.cap)
+    {
+        size_t cap = (journal.len + n + 1) * 2;
+        char *p = realloc(journal.buf, cap);
+        if (!p)
+        {
+            pthread_mutex_unlock(&journal.lock);
+            return;
+        }
+        journal.buf = p;
+        journal.cap = cap;
+    }
+    memcpy(journal.buf + journal.len, cmd, n);
+    journal.buf[journal.len + n] = '\n';
+    journal.len += n + 1;
+    if (!journal.started)
+        journal.started = pthread_create(&journal.thread, NULL, journal_thread, NULL) == 0;
+    pthread_cond_signal(&journal.cond);
+    pthread_mutex_unlock(&journal.lock);
+}
+
+// Flush and fsync whatever is queued and stop the writer
+static void journal_close(void)
+{
+    pthread_mutex_lock(&journal.lock);
+    int started = journal.started;
+    journal.quit = 1;
+    pthread_cond_signal(&journal.cond);
+    pthread_mutex_unlock(&journal.lock);
+    if (started)
+        pthread_join(journal.thread, NULL);
+    free(journal.buf);
+    journal.buf = NULL;
+}
+
+static void hist_free(void)
+{
+    hist_wait();
+    for (int i = 0; i < shared_hist.count; i++)
+        hist_release(shared_hist.items[i]);
+    shared_hist.count = 0;
+    hidx_free(&shared_hist.hidx);
+    if (shared_hist.map)
+        munmap(shared_hist.map, shared_hist.map_len);
+    shared_hist.map = NULL;
+}
+static void search_history(Tab *t)
+{
+    tb_append(&t->tb, "Enter search term: ");
+    ui_needs_redraw = 1;
+
+    char term[INPUT_MAX];
+    int len = 0;
+    int c;
+
+    // read character by character from stdin
+    while ((c = getchar()) != '\n' && c != EOF && len < INPUT_MAX - 1)
+        term[len++] = c;
+    term[len] = '\0';
+
+    if (len == 0)
+    {
+        tb_append(&t->tb, "No term entered.");
+        return;
+    }
+
+    // --- 1️⃣ Exact match search ---
+    HistIndex *hx = &shared_hist.hidx;
+    int exact_index = hidx_exact(hx, term);
+    if (exact_index >= 0)
+    {
+        char msg[INPUT_MAX + 64];
+        snprintf(msg, sizeof(msg),
+                 "Exact match found: %s", hidx_text(hx, exact_index));
+        tb_append(&t->tb, msg);
+        return;
+    }
+
+    // --- Substring match (longest) ---
+    int matches[20], mcount;
+    int best_len = hidx_longest(hx, term, matches, 20, &mcount);
+
+    if (best_len > 2 && mcount > 0)
+    {
+        tb_append(&t->tb, "Closest matches:");
+        for (int i = 0; i < mcount; i++)
+            tb_append(&t->tb, hidx_text(hx, matches[i]));
+    }
+    else
+    {
+        tb_append(&t->tb, "No match for search term in history.");
+    }
+}
+/* return index in history for exact match (most recent), or -1 */
+static int history_exact_match(const char *term)
+{
+    if (!term || term[0] == '\0')
+        return -1;
+    int id = hidx_exact(&shared_hist.hidx, term);
+    return id < 0 ? -1 : id - shared_hist.hidx.base;
+}
+
+/* return index of the most recent history entry starting with 'prefix', or -1 */
+static int history_prefix_match(const char *prefix)
+{
+    int id = hidx_prefix(&shared_hist.hidx, prefix, strlen(prefix));
+    return id < 0 ? -1 : id - shared_hist.hidx.base;
+}
+
+/* return index of the most recent history entry that contains the longest
+   substring of 'term' (substring length must be >2; shorter terms must
+   match whole), or -1 if none */
+static int history_longest_substring(const char *term)
+{
+    if (!term || term[0] == '\0')
+        return -1;
+    int ids[1], n;
+    int tlen = strlen(term);
+    if (tlen < 3)
+        n = hidx_contains(&shared_hist.hidx, term, tlen, ids, 1);
+    else
+        hidx_longest(&shared_hist.hidx, term, ids, 1, &n);
+    return n > 0 ? ids[0] - shared_hist.hidx.base : -1;
+}
+
+/* Ctrl+R finder. Opening it collects the distinct commands (newest
+   occurrence of each) with their run counts. Every keystroke scores the
+   candidates against the query; when the query only grew, just the
+   previous matches are rescored. Rank = fuzzy match quality + frequency -
+   age. Large candidate sets are scored in slices on worker threads. The
+   ranked list is computed here, on input, and draw_input only reads it. */
+#define HF_MAX_THREADS 8
+#define HF_SLICE 8192 // candidates per thread before scoring goes parallel
+
+static int hf_boundary(const char *s, int p)
+{
+    return p == 0 || strchr(" /-_.=:", s[p - 1]) != NULL;
+}
+
+/* Fuzzy score of s for q: every query byte must appear in order
+   (case-insensitively). Runs, word starts and an exact substring score up;
+   gaps score down. Returns -1 when q is not a subsequence of s. */
+static int hf_fuzzy(const char *s, const char *q, int qlen)
+{
+    if (qlen == 0)
+        return 0;
+    int score = 0, prev = -1, p = 0;
+    for (int i = 0; i < qlen; i++)
+    {
+        int qc = tolower((unsigned char)q[i]);
+        while (s[p] && tolower((unsigned char)s[p]) != qc)
+            p++;
+        if (!s[p])
+            return -1;
+        score += 16;
+        if (prev >= 0 && p == prev + 1)
+            score += 24;
+        else if (prev >= 0)
+            score -= p - prev - 1 < 12 ? p - prev - 1 : 12;
+        if (hf_boundary(s, p))
+            score += 12;
+        if (s[p] == q[i])
+            score += 2;
+        prev = p++;
+    }
+    const char *sub = find_sub(s, strlen(s), q, qlen);
+    if (sub)
+        score += sub == s ? 80 : 40;
+    return score;
+}
+
+typedef struct
+{
+    const HistFinder *hf;
+    const HistIndex *hx;
+    const int *cand;
+    int from, to;
+    int *score; // per candidate slot in hf->ids
+} HfSlice;
+
+static void *hf_score_slice(void *arg)
+{
+    HfSlice *sl = arg;
+    const HistFinder *hf = sl->hf;
+    int qlen = strlen(hf->query);
+    for (int i = sl->from; i < sl->to; i++)
+    {
+        int k = sl->cand[i];
+        int m = hf_fuzzy(hidx_text(sl->hx, hf->ids[k]), hf->query, qlen);
+        // frecency: frequent commands rise, old ones sink (k is the age rank)
+        sl->score[k] = m < 0 ? INT_MIN : m * 4 + 24 * (31 - __builtin_clz(hf->freq[k] + 1)) -
+                                             12 * (31 - __builtin_clz(k + 1));
+    }
+    return NULL;
+}
+
+static const int *rank_score; // qsort has no portable context argument
+
+static int hf_cmp(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+    if (rank_score[x] != rank_score[y])
+        return rank_score[x] > rank_score[y] ? -1 : 1;
+    return x - y; // newer first
+}
+
+static void hf_close(HistFinder *hf)
+{
+    free(hf->ids);
+    free(hf->freq);
+    free(hf->match);
+    free(hf->ranked);
+    free(hf->score);
+    memset(hf, 0, sizeof(*hf));
+}
+
+// Re-rank for query q
+static void hf_update(Tab *t, const char *q)
+{
+    HistFinder *hf = &t->finder;
+    const int *cand = hf->match;
+    int ncand = hf->nmatch;
+    if (!hf->has_match || strncmp(q, hf->query, strlen(hf->query)) != 0)
+    {
+        // not an extension of the last query: start from every command
+        for (int i = 0; i < hf->nids; i++)
+            hf->ranked[i] = i;
+        cand = hf->ranked;
+        ncand = hf->nids;
+    }
+    snprintf(hf->query, sizeof(hf->query), "%s", q);
+    find_sub_init();
+
+    int nthreads = ncand / HF_SLICE + 1;
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads > ncpu)
+        nthreads = ncpu < 1 ? 1 : (int)ncpu;
+    if (nthreads > HF_MAX_THREADS)
+        nthreads = HF_MAX_THREADS;
+    HfSlice sl[HF_MAX_THREADS];
+    pthread_t th[HF_MAX_THREADS];
+    int started[HF_MAX_THREADS] = {0};
+    for (int i = 0; i < nthreads; i++)
+    {
+        sl[i] = (HfSlice){hf, &shared_hist.hidx, cand, (int)((long)ncand * i / nthreads),
+                          (int)((long)ncand * (i + 1) / nthreads), hf->score};
+        if (i > 0)
+            started[i] = pthread_create(&th[i], NULL, hf_score_slice, &sl[i]) == 0;
+        if (i > 0 && !started[i])
+            hf_score_slice(&sl[i]);
+    }
+    hf_score_slice(&sl[0]);
+    for (int i = 1; i < nthreads; i++)
+        if (started[i])
+            pthread_join(th[i], NULL);
+
+    // keep the survivors in age order for the next keystroke, then rank them
+    int n = 0;
+    for (int i = 0; i < ncand; i++)
+        if (hf->score[cand[i]] != INT_MIN)
+            hf->match[n++] = cand[i]; // cand is never behind match, so in place is safe
+    hf->nmatch = n;
+    hf->has_match = 1;
+    memcpy(hf->ranked, hf->match, sizeof(int) * n);
+    rank_score = hf->score;
+    qsort(hf->ranked, n, sizeof(int), hf_cmp);
+    hf->sel = 0;
+    hf->top = 0;
+    hf->gen++;
+}
+
+static void hf_open(Tab *t)
+{
+    HistFinder *hf = &t->finder;
+    hist_wait();
+    const HistIndex *hx = &shared_hist.hidx;
+    hf_close(hf);
+    int n = shared_hist.count;
+    hf->ids = malloc(sizeof(int) * (n + 1));
+    hf->freq = calloc(n + 1, sizeof(int));
+    hf->match = malloc(sizeof(int) * (n + 1));
+    hf->ranked = malloc(sizeof(int) * (n + 1));
+    hf->score = malloc(sizeof(int) * (n + 1));
+    int *slot = malloc(sizeof(int) * (n + 1));
+    if (!hf->ids || !hf->freq || !hf->match || !hf->ranked || !hf->score || !slot)
+    {
+        free(slot);
+        hf_close(hf);
+        return;
+    }
+    /* distinct commands in t's view, newest first; slot maps the newest id
+       of a text (in any tab) to its index in ids */
+    for (int i = 0; i < hx->next - hx->base; i++)
+        slot[i] = -1;
+    for (int id = hx->next - 1; id >= hx->base; id--)
+    {
+        if (!hist_visible(t, id))
+            continue;
+        int newest = hidx_exact(hx, hidx_text(hx, id));
+        if (newest < 0)
+            continue;
+        if (slot[newest - hx->base] < 0)
+        {
+            slot[newest - hx->base] = hf->nids;
+            hf->ids[hf->nids++] = id;
+        }
+        hf->freq[slot[newest - hx->base]]++;
+    }
+    free(slot);
+    hf_update(t, "");
+}
+
+// Move the selection by delta rows, clamped to the list
+static void hf_move(HistFinder *hf, int delta)
+{
+    hf->sel += delta;
+    if (hf->sel >= hf->nmatch)
+        hf->sel = hf->nmatch - 1;
+    if (hf->sel < 0)
+        hf->sel = 0;
+    hf->gen++;
+}
+
+// Rows the finder list takes from the output area
+static int hf_list_rows(int rows)
+{
+    int n = rows / 2;
+    return n > 8 ? 8 : n < 1 ? 1 : n;
+}
+
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void set_nonblock(int fd)
+{
+    int f = fcntl(fd, F_GETFL, 0);
+    if (f >= 0)
+        fcntl(fd, F_SETFL, f | O_NONBLOCK);
+}
+
+// ===== Job Handling =====
+static Job *add_job(Tab *t, pid_t pid, int master_fd, const char *cmd)
+{
+    if (t->job_count >= MAX_JOBS)
+        return NULL;
+    t->jobs[t->job_count].pid = pid;
+    t->jobs[t->job_count].nstages = 0;
+    t->jobs[t->job_count].exited = 0;
+    t->jobs[t->job_count].lost = 0;
+    t->jobs[t->job_count].master_fd = master_fd;
+    t->jobs[t->job_count].active = 1;
+    strncpy(t->jobs[t->job_count].cmd, cmd, sizeof(t->jobs[t->job_count].cmd) - 1);
+    t->jobs[t->job_count].cmd[sizeof(t->jobs[t->job_count].cmd) - 1] = '\0';
+    if (master_fd >= 0)
+        set_nonblock(master_fd);
+    return &t->jobs[t->job_count++];
+}
+
+/* A tab's foreground command is just one of its jobs, the one whose pid is
+   t->fg_pid: its output is streamed by check_jobs like any other, and
+   Ctrl+Z demotes it by clearing fg_pid. Each tab has its own, so a busy
+   tab only holds up its own input line. */
+static Job *tab_fg_job(Tab *t)
+{
+    if (t->fg_pid <= 0)
+        return NULL;
+    for (int i = 0; i < t->job_count; i++)
+        if (t->jobs[i].active && t->jobs[i].pid == t->fg_pid)
+            return &t->jobs[i];
+    return NULL;
+}
+
+static int tab_has_fg_job(Tab *t)
+{
+    return tab_fg_job(t) != NULL;
+}
+// Async-signal-safe: make the main loop's poll() return
+static void wake_loop(void)
+{
+    int saved = errno;
+    if (wake_pipe[1] >= 0)
+        (void)!write(wake_pipe[1], "x", 1);
+    errno = saved;
+}
+
+// === Ctrl+C (SIGINT) and Ctrl+Z (SIGTSTP) go to the tab's foreground job ===
+static void tab_signal_fg(Tab *t, int sig)
+{
+    Job *job = tab_fg_job(t);
+    char msg[128];
+    if (job)
+    {
+        // every stage of the pipeline, as the terminal would with a process group
+        for (int i = 0; i < job->nstages; i++)
+            if (job->stage_pids[i] > 0) // -1: reaped, or never started
+                kill(job->stage_pids[i], sig);
+        kill(job->pid, sig);
+        snprintf(msg, sizeof(msg), sig == SIGINT ? "[MyTerm] Foreground process (%d) interrupted"
+                                                 : "[MyTerm] Foreground process (%d) stopped (backgrounded)",
+                 job->pid);
+        if (sig == SIGTSTP)
+            t->fg_pid = -1; // its Job stays in the tab and is now a background job
+    }
+    else
+        snprintf(msg, sizeof(msg), "[MyTerm] No foreground job to %s", sig == SIGINT ? "interrupt" : "stop");
+    tb_append(&t->tb, msg);
+    ui_needs_redraw = 1;
+}
+
+// The same keys typed at the terminal MyTerm was started from
+void handle_sigint(int sig)
+{
+    (void)sig;
+    pending_sig = SIGINT;
+    wake_loop();
+}
+
+void handle_sigtstp(int sig)
+{
+    (void)sig;
+    pending_sig = SIGTSTP;
+    wake_loop();
+}
+
+void handle_sigchld(int sig)
+{
+    (void)sig;
+    child_exited = 1;
+    wake_loop();
+}
+
+/* Record the exit of pid (a job's last stage or an earlier one) on the job
+   that owns it. Children of the zygote are reported by zygote_reap, local
+   ones by reap_children: once SIGCHLD has fired, it collects every exited
+   child with wait4. Nothing is polled while
+   no child has exited. Tabs holding a finished job are flagged in tab_ready. */
+static void job_exited(Tab *tabs, int tab_count, pid_t pid, int st, const struct rusage *ru, int *tab_ready)
+{
+    for (int ti = 0; ti < tab_count; ti++)
+        for (int j = 0; j < tabs[ti].job_count; j++)
+        {
+            Job *job = &tabs[ti].jobs[j];
+            if (!job->active)
+                continue;
+            if (job->pid == pid)
+            {
+                job->exited = 1;
+                job->status = st;
+                job->usage = *ru;
+                tab_ready[ti] = 1;
+            }
+            for (int s = 0; s < job->nstages; s++)
+                if (job->stage_pids[s] == pid)
+                    job->stage_pids[s] = -1;
+        }
+}
+
+// BSD, not POSIX: _XOPEN_SOURCE hides the declaration
+pid_t wait4(pid_t pid, int *status, int options, struct rusage *ru);
+
+static void reap_children(Tab *tabs, int tab_count, int *tab_ready)
+{
+    int st;
+    struct rusage ru;
+    pid_t pid;
+    while ((pid = wait4(-1, &st, WNOHANG, &ru)) > 0)
+        job_exited(tabs, tab_count, pid, st, &ru, tab_ready);
+}
+
+/* check_jobs: non-blocking reads from job fds; retires jobs reap_children
+   saw exit. Each job gets at most budget bytes, and once deadline (now_ns)
+   has passed the current job stops and the rest wait for the next turn, so a job flooding
+   output cannot starve the others, other tabs or the keyboard. Whatever is
+   left sets t->jobs_pending and is read first on the next turn. */
+static void check_jobs(Tab *t, size_t budget, long long deadline)
+{
+    t->jobs_pending = 0;
+    for (int n = 0; n < t->job_count; n++)
+    {
+        int i = (t->job_rr + n) % t->job_count;
+        if (!t->jobs[i].active)
+            continue;
+        if (n > 0 && now_ns() >= deadline)
+        {
+            t->job_rr = i;
+            t->jobs_pending = 1;
+            return;
+        }
+
+        // Read the job's share of its available output
+        size_t got = 0, cap = budget;
+        if (t->jobs[i].master_fd >= 0)
+        {
+            char buf[16384];
+            ssize_t r = 0;
+            while (got < cap &&
+                   (r = read(t->jobs[i].master_fd, buf,
+                             cap - got < sizeof(buf) ? cap - got : sizeof(buf))) > 0)
+            {
+                tb_append_bytes(&t->tb, buf, r);
+                got += r;
+                ui_needs_redraw = 1;
+                if (now_ns() >= deadline)
+                    cap = got; // out of time: the rest waits too
+            }
+            if (got >= cap)
+                t->jobs_pending = 1; // more may be waiting
+            else if (r == 0)
+            {
+                // EOF on job output - close fd (but still wait for process reap)
+                close(t->jobs[i].master_fd);
+                t->jobs[i].master_fd = -1;
+            }
+            else if (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                // Unexpected read error
+                close(t->jobs[i].master_fd);
+                t->jobs[i].master_fd = -1;
+            }
+        }
+
+        if (t->jobs[i].exited)
+        {
+            if (t->jobs[i].master_fd >= 0 && got >= cap)
+                continue; // show all of its output before the exit status
+            int st = t->jobs[i].status;
+            // job finished
+            t->jobs[i].active = 0;
+            if (t->jobs[i].master_fd >= 0)
+            {
+                // pick up whatever was written between the last read and exit
+                char buf[65536];
+                ssize_t r;
+                while ((r = read(t->jobs[i].master_fd, buf, sizeof(buf))) > 0)
+                    tb_append_bytes(&t->tb, buf, r);
+                close(t->jobs[i].master_fd);
+                t->jobs[i].master_fd = -1;
+            }
+            if (t->jobs[i].lost)
+            {
+                if (t->jobs[i].pid == t->fg_pid)
+                    t->fg_pid = -1;
+                char msg[320];
+                snprintf(msg, sizeof(msg), "[%d] Lost (the launcher exited; hung up)  %s", t->jobs[i].pid, t->jobs[i].cmd);
+                tb_append(&t->tb, msg);
+                ui_needs_redraw = 1;
+                continue;
+            }
+            if (t->jobs[i].pid == t->fg_pid)
+            {
+                t->fg_pid = -1;
+                tb_append(&t->tb, "Command finished.");
+                t->scroll_offset = 0; // ✅ auto-scroll to bottom
+                ui_needs_redraw = 1;
+                continue;
+            }
+            ui_needs_redraw = 1;
+            const struct rusage *ru = &t->jobs[i].usage;
+            char times[64];
+            snprintf(times, sizeof(times), "%ld.%02lds user %ld.%02lds sys",
+                     (long)ru->ru_utime.tv_sec, (long)ru->ru_utime.tv_usec / 10000,
+                     (long)ru->ru_stime.tv_sec, (long)ru->ru_stime.tv_usec / 10000);
+            char msg[384];
+            if (WIFEXITED(st))
+            {
+                snprintf(msg, sizeof(msg), "[%d] Done (exit %d, %s)  %s", t->jobs[i].pid, WEXITSTATUS(st), times, t->jobs[i].cmd);
+            }
+            else if (WIFSIGNALED(st))
+            {
+                snprintf(msg, sizeof(msg), "[%d] Terminated by signal %d (%s)  %s", t->jobs[i].pid, WTERMSIG(st), times, t->jobs[i].cmd);
+            }
+            else
+            {
+                snprintf(msg, sizeof(msg), "[%d] Done (%s)  %s", t->jobs[i].pid, times, t->jobs[i].cmd);
+            }
+            tb_append(&t->tb, msg);
+        }
+    }
+    t->job_rr = t->job_count ? (t->job_rr + 1) % t->job_count : 0;
+}
+// ===== Completion index =====
+/* Tab completion looks names up in a sorted snapshot of each directory
+   instead of scanning it on every press. Snapshots are built on a worker
+   thread and cached for the DC_SLOTS most recently used directories. On
+   Linux inotify marks a snapshot stale; elsewhere (or when no watch could
+   be added) the directory's mtime is compared on lookup. The names that
+   start with a prefix form one contiguous range of the sorted array, found
+   by binary search, and their longest common prefix is simply that of the
+   first and last name in the range. */
+#define DC_SLOTS 8
+#define DC_WAIT_MS 50 // how long Tab waits for a snapshot being (re)built
+#define AC_LIST_MAX 100 // matches listed by Tab; the rest are only counted
+
+typedef struct
+{
+    char **names; // sorted by strcmp
+    int count;
+    char *arena;  // the names' text, each optionally followed by a value
+} NameList;
+
+// A NameList being filled; names are arena offsets until name_buf_finish
+typedef struct
+{
+    char *arena;
+    size_t len, cap;
+    size_t *off;
+    int count, off_cap;
+} NameBuf;
+
+// Add name, with an optional value string stored right after it
+static int name_buf_add(NameBuf *nb, const char *name, const char *value)
+{
+    size_t n = strlen(name) + 1, v = value ? strlen(value) + 1 : 0;
+    if (nb->len + n + v > nb->cap)
+    {
+        size_t cap = nb->cap ? nb->cap * 2 : 16384;
+        while (cap < nb->len + n + v)
+            cap *= 2;
+        char *p = realloc(nb->arena, cap);
+        if (!p)
+            return -1;
+        nb->arena = p;
+        nb->cap = cap;
+    }
+    if (nb->count == nb->off_cap)
+    {
+        int cap = nb->off_cap ? nb->off_cap * 2 : 1024;
+        size_t *p = realloc(nb->off, sizeof(size_t) * cap);
+        if (!p)
+            return -1;
+        nb->off = p;
+        nb->off_cap = cap;
+    }
+    memcpy(nb->arena + nb->len, name, n);
+    if (v)
+        memcpy(nb->arena + nb->len + n, value, v);
+    nb->off[nb->count++] = nb->len;
+    nb->len += n + v;
+    return 0;
+}
+
+// The value stored after name by name_buf_add
+static const char *name_value(const char *name)
+{
+    return name + strlen(name) + 1;
+}
+
+// By name, then by order of insertion (all names share one arena)
+static int name_cmp(const void *a, const void *b)
+{
+    const char *x = *(char *const *)a, *y = *(char *const *)b;
+    int c = strcmp(x, y);
+    return c ? c : (x > y) - (x < y);
+}
+
+static void name_list_free(NameList *nl)
+{
+    free(nl->names);
+    free(nl->arena);
+    memset(nl, 0, sizeof(*nl));
+}
+
+// Sort nb's names into nl, keeping the first added of equal names; nb is consumed either way
+static int name_buf_finish(NameBuf *nb, NameList *nl)
+{
+    nl->names = malloc(sizeof(char *) * (nb->count + 1));
+    if (!nl->names)
+    {
+        free(nb->arena);
+        free(nb->off);
+        return -1;
+    }
+    for (int i = 0; i < nb->count; i++)
+        nl->names[i] = nb->arena + nb->off[i];
+    qsort(nl->names, nb->count, sizeof(char *), name_cmp);
+    nl->count = 0;
+    for (int i = 0; i < nb->count; i++)
+        if (i == 0 || strcmp(nl->names[i], nl->names[nl->count - 1]) != 0)
+            nl->names[nl->count++] = nl->names[i];
+    nl->arena = nb->arena;
+    free(nb->off);
+    return 0;
+}
+
+// Range [*lo, *hi) of the names that start with prefix[0..n)
+static void name_range(const NameList *nl, const char *prefix, size_t n, int *lo, int *hi)
+{
+    int a = 0, b = nl->count;
+    while (a < b)
+    {
+        int m = (a + b) / 2;
+        if (strncmp(nl->names[m], prefix, n) < 0)
+            a = m + 1;
+        else
+            b = m;
+    }
+    *lo = a;
+    b = nl->count;
+    while (a < b)
+    {
+        int m = (a + b) / 2;
+        if (strncmp(nl->names[m], prefix, n) <= 0)
+            a = m + 1;
+        else
+            b = m;
+    }
+    *hi = a;
+}
+
+// Longest common prefix of names[lo..hi), hi > lo
+static size_t name_lcp(const NameList *nl, int lo, int hi)
+{
+    const char *a = nl->names[lo], *b = nl->names[hi - 1];
+    size_t i = 0;
+    while (a[i] && a[i] == b[i])
+        i++;
+    return i;
+}
+
+typedef struct
+{
+    char path[PATH_MAX];   // canonical
+    NameList list;
+    int valid;             // list matches the directory as of the last check
+    int building;
+    unsigned gen;          // bumped when the slot is reused
+    unsigned stamp;        // bumped on every invalidation
+    unsigned long long used;
+    struct timespec mtime; // directory mtime when the last build started
+    int wd;                // inotify watch, -1 = none
+} DirCache;
+
+typedef struct
+{
+    int slot;
+    unsigned gen, stamp;
+    char path[PATH_MAX];
+} DirCacheJob;
+
+static DirCache dir_cache[DC_SLOTS];
+static unsigned long long dc_clock;
+static pthread_mutex_t dc_lock = PTHREAD_MUTEX_INITIALIZER; // guards dir_cache
+static pthread_cond_t dc_done = PTHREAD_COND_INITIALIZER;   // a build finished
+#ifdef __linux__
+static int dc_inotify = -2; // -2 = not opened yet, -1 = unavailable
+#endif
+
+static struct timespec dir_mtime(const struct stat *st)
+{
+#ifdef __APPLE__
+    return st->st_mtimespec;
+#else
+    return st->st_mtim;
+#endif
+}
+
+static void *dc_build_thread(void *arg)
+{
+    DirCacheJob *job = arg;
+    NameBuf nb = {0};
+    NameList nl = {0};
+    int ok = 0;
+    DIR *d = opendir(job->path);
+    if (d)
+    {
+        struct dirent *de;
+        ok = 1;
+        while (ok && (de = readdir(d)) != NULL)
+            if (strcmp(de->d_name, ".") && strcmp(de->d_name, ".."))
+                ok = name_buf_add(&nb, de->d_name, NULL) == 0;
+        closedir(d);
+    }
+    if (ok)
+        ok = name_buf_finish(&nb, &nl) == 0;
+    else
+    {
+        free(nb.arena);
+        free(nb.off);
+    }
+
+    pthread_mutex_lock(&dc_lock);
+    DirCache *dc = &dir_cache[job->slot];
+    if (dc->gen == job->gen)
+    {
+        dc->building = 0;
+        if (ok)
+        {
+            name_list_free(&dc->list);
+            dc->list = nl;
+            nl = (NameList){0};
+            // changes seen while reading mean the snapshot is stale already
+            dc->valid = dc->stamp == job->stamp;
+        }
+    }
+    pthread_cond_broadcast(&dc_done);
+    pthread_mutex_unlock(&dc_lock);
+    name_list_free(&nl);
+    free(job);
+    return NULL;
+}
+
+static void dc_invalidate(DirCache *dc)
+{
+    dc->valid = 0;
+    dc->stamp++;
+}
+
+// Apply pending invalidations to every slot; dc_lock held
+static void dc_check(void)
+{
+#ifdef __linux__
+    if (dc_inotify >= 0)
+    {
+        char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        ssize_t n;
+        while ((n = read(dc_inotify, buf, sizeof(buf))) > 0)
+            for (char *p = buf; p < buf + n; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len)
+            {
+                const struct inotify_event *ev = (const struct inotify_event *)p;
+                for (int i = 0; i < DC_SLOTS; i++)
+                    if (ev->mask & IN_Q_OVERFLOW || (dir_cache[i].wd >= 0 && dir_cache[i].wd == ev->wd))
+                    {
+                        dc_invalidate(&dir_cache[i]);
+                        if (ev->mask & IN_IGNORED) // the watch is gone with the directory
+                            dir_cache[i].wd = -1;
+                    }
+            }
+    }
+#endif
+    for (int i = 0; i < DC_SLOTS; i++)
+    {
+        DirCache *dc = &dir_cache[i];
+        struct stat st;
+        if (dc->valid && dc->wd < 0 &&
+            (stat(dc->path, &st) != 0 || dir_mtime(&st).tv_sec != dc->mtime.tv_sec ||
+             dir_mtime(&st).tv_nsec != dc->mtime.tv_nsec))
+            dc_invalidate(dc);
+    }
+}
+
+// Rebuild dc in the background unless it is current or already building; dc_lock held
+static void dc_refresh(DirCache *dc)
+{
+    if (dc->valid || dc->building)
+        return;
+    DirCacheJob *job = malloc(sizeof(*job));
+    if (!job)
+        return;
+    struct stat st;
+    if (stat(dc->path, &st) == 0)
+        dc->mtime = dir_mtime(&st);
+#ifdef __linux__
+    if (dc_inotify == -2)
+        dc_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (dc->wd < 0 && dc_inotify >= 0)
+        dc->wd = inotify_add_watch(dc_inotify, dc->path,
+                                   IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                       IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+#endif
+    job->slot = dc - dir_cache;
+    job->gen = dc->gen;
+    job->stamp = dc->stamp;
+    snprintf(job->path, sizeof(job->path), "%s", dc->path);
+    dc->building = 1;
+    pthread_t th;
+    if (pthread_create(&th, NULL, dc_build_thread, job) == 0)
+        pthread_detach(th);
+    else
+    {
+        pthread_mutex_unlock(&dc_lock);
+        dc_build_thread(job);
+        pthread_mutex_lock(&dc_lock);
+    }
+}
+
+// The slot for dir, taking over the least recently used one if needed; dc_lock held
+static DirCache *dc_slot(const char *dir)
+{
+    char path[PATH_MAX];
+    if (!realpath(dir, path))
+        return NULL;
+    DirCache *dc = NULL, *lru = &dir_cache[0];
+    for (int i = 0; i < DC_SLOTS && !dc; i++)
+    {
+        if (dir_cache[i].gen && strcmp(dir_cache[i].path, path) == 0)
+            dc = &dir_cache[i];
+        else if (dir_cache[i].used < lru->used)
+            lru = &dir_cache[i];
+    }
+    if (!dc)
+    {
+        dc = lru;
+#ifdef __linux__
+        if (dc->gen && dc->wd >= 0)
+            inotify_rm_watch(dc_inotify, dc->wd);
+#endif
+        name_list_free(&dc->list);
+        unsigned gen = dc->gen + 1;
+        memset(dc, 0, sizeof(*dc));
+        dc->gen = gen; // an old build still running sees the change and discards its result
+        dc->wd = -1;
+        snprintf(dc->path, sizeof(dc->path), "%s", path);
+    }
+    dc->used = ++dc_clock;
+    return dc;
+}
+
+// Start indexing dir ahead of the first Tab press (new tab, cd)
+static void dc_prefetch(const char *dir)
+{
+    pthread_mutex_lock(&dc_lock);
+    dc_check();
+    DirCache *dc = dc_slot(dir);
+    if (dc)
+        dc_refresh(dc);
+    pthread_mutex_unlock(&dc_lock);
+}
+
+/* Executables on $PATH, for completing the first word and for resolving
+   argv[0] without execvp's search. Built on a worker thread from the
+   directories in PATH order; each name is followed in the arena by the
+   full path of its first occurrence. Refreshed when PATH changes or one of
+   its directories does (inotify on Linux; elsewhere their mtimes, checked
+   at most once a second). Guarded by dc_lock, like the directory cache. */
+#define PI_MAX_DIRS 64
+#define PI_RECHECK_NS 1000000000LL
+
+typedef struct
+{
+    NameList list;
+    char *env;      // the PATH it was built from
+    char *dirbuf;   // env split into dirs
+    char *dirs[PI_MAX_DIRS];
+    struct timespec mtime[PI_MAX_DIRS];
+    int ndirs;
+    int valid, building;
+    unsigned stamp; // bumped on every invalidation
+    long long checked_ns;
+#ifdef __linux__
+    int inotify;
+#endif
+} PathIndex;
+
+typedef struct
+{
+    unsigned stamp;
+    int ndirs;
+    char *dirs[PI_MAX_DIRS];
+    char *dirbuf;
+} PathIndexJob;
+
+static PathIndex path_index = {
+    .valid = 0,
+#ifdef __linux__
+    .inotify = -1,
+#endif
+};
+
+static const char *path_env(void)
+{
+    const char *env = getenv("PATH");
+    return env ? env : "/usr/bin:/bin"; // execvp's default
+}
+
+static void *path_index_thread(void *arg)
+{
+    PathIndexJob *job = arg;
+    NameBuf nb = {0};
+    NameList nl = {0};
+    int ok = 1;
+    for (int i = 0; ok && i < job->ndirs; i++)
+    {
+        DIR *d = opendir(job->dirs[i]);
+        if (!d)
+            continue;
+        struct dirent *de;
+        while (ok && (de = readdir(d)) != NULL)
+        {
+            struct stat st;
+            char full[PATH_MAX];
+            if (de->d_name[0] == '.' || fstatat(dirfd(d), de->d_name, &st, 0) != 0 ||
+                !S_ISREG(st.st_mode) || !(st.st_mode & 0111))
+                continue;
+            snprintf(full, sizeof(full), "%s/%s", job->dirs[i], de->d_name);
+            ok = name_buf_add(&nb, de->d_name, full) == 0;
+        }
+        closedir(d);
+    }
+    if (ok)
+        ok = name_buf_finish(&nb, &nl) == 0;
+    else
+    {
+        free(nb.arena);
+        free(nb.off);
+    }
+
+    pthread_mutex_lock(&dc_lock);
+    PathIndex *pi = &path_index;
+    pi->building = 0;
+    if (ok)
+    {
+        name_list_free(&pi->list);
+        pi->list = nl;
+        nl = (NameList){0};
+        pi->valid = pi->stamp == job->stamp;
+    }
+    pthread_cond_broadcast(&dc_done);
+    pthread_mutex_unlock(&dc_lock);
+    name_list_free(&nl);
+    free(job->dirbuf);
+    free(job);
+    return NULL;
+}
+
+// Start a rebuild from the current PATH; dc_lock held
+static void path_index_rebuild(void)
+{
+    PathIndex *pi = &path_index;
+    PathIndexJob *job = malloc(sizeof(*job));
+    char *env = strdup(path_env()), *dirbuf = strdup(env ? env : ""), *jobbuf = strdup(env ? env : "");
+    if (!job || !env || !dirbuf || !jobbuf)
+    {
+        free(job);
+        free(env);
+        free(dirbuf);
+        free(jobbuf);
+        return;
+    }
+    free(pi->env);
+    free(pi->dirbuf);
+    pi->env = env;
+    pi->dirbuf = dirbuf;
+    pi->ndirs = job->ndirs = 0;
+#ifdef __linux__
+    if (pi->inotify >= 0)
+        close(pi->inotify); // drops the old watches
+    pi->inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+    char *dir = dirbuf, *jdir = jobbuf;
+    for (; dir && pi->ndirs < PI_MAX_DIRS; )
+    {
+        char *next = strchr(dir, ':'), *jnext = strchr(jdir, ':');
+        if (next)
+        {
+            *next++ = '\0';
+            *jnext++ = '\0';
+        }
+        /* An empty or relative entry means a directory that depends on the
+           cwd, and it shadows every entry after it: index only up to it, so
+           names it could hold stay unresolved and execvp searches for them. */
+        if (dir[0] != '/')
+            break;
+        struct stat st;
+        pi->dirs[pi->ndirs] = dir;
+        pi->mtime[pi->ndirs] = stat(dir, &st) == 0 ? dir_mtime(&st) : (struct timespec){0};
+#ifdef __linux__
+        if (pi->inotify >= 0)
+            inotify_add_watch(pi->inotify, dir,
+                              IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB |
+                                  IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+#endif
+        job->dirs[job->ndirs++] = jdir;
+        pi->ndirs++;
+        dir = next;
+        jdir = jnext;
+    }
+    job->dirbuf = jobbuf;
+    job->stamp = pi->stamp;
+    pi->building = 1;
+    pthread_t th;
+    if (pthread_create(&th, NULL, path_index_thread, job) == 0)
+        pthread_detach(th);
+    else
+    {
+        pthread_mutex_unlock(&dc_lock);
+        path_index_thread(job);
+        pthread_mutex_lock(&dc_lock);
+    }
+}
+
+// Invalidate the index if PATH or its directories changed, and rebuild; dc_lock held
+static void path_index_check(void)
+{
+    PathIndex *pi = &path_index;
+    int changed = !pi->env || strcmp(pi->env, path_env()) != 0, watched = 0;
+#ifdef __linux__
+    if (pi->inotify >= 0)
+    {
+        char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        while (read(pi->inotify, buf, sizeof(buf)) > 0)
+            changed = 1;
+        watched = 1;
+    }
+#endif
+    if (!watched && pi->valid && now_ns() - pi->checked_ns >= PI_RECHECK_NS)
+    {
+        pi->checked_ns = now_ns();
+        for (int i = 0; i < pi->ndirs && !changed; i++)
+        {
+            struct stat st;
+            struct timespec m = stat(pi->dirs[i], &st) == 0 ? dir_mtime(&st) : (struct timespec){0};
+            changed = m.tv_sec != pi->mtime[i].tv_sec || m.tv_nsec != pi->mtime[i].tv_nsec;
+        }
+    }
+    if (changed)
+    {
+        pi->valid = 0;
+        pi->stamp++;
+    }
+    if (!pi->valid && !pi->building)
+        path_index_rebuild();
+}
+
+/* Full path of the executable execvp would run for name, into out; 0 when
+   it is not (yet) indexed and execvp has to search. */
+static int path_resolve(const char *name, char *out, size_t n)
+{
+    if (!name || !name[0] || strchr(name, '/'))
+        return 0;
+    int found = 0, lo, hi;
+    pthread_mutex_lock(&dc_lock);
+    path_index_check();
+    name_range(&path_index.list, name, strlen(name) + 1, &lo, &hi); // + 1: whole name
+    if (hi > lo)
+        found = snprintf(out, n, "%s", name_value(path_index.list.names[lo])) < (int)n;
+    pthread_mutex_unlock(&dc_lock);
+    return found;
+}
+
+// Start indexing $PATH at startup
+static void path_index_prefetch(void)
+{
+    pthread_mutex_lock(&dc_lock);
+    path_index_check();
+    pthread_mutex_unlock(&dc_lock);
+}
+
+// Wait up to DC_WAIT_MS for *building to clear; dc_lock held
+static void dc_wait(const int *building)
+{
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_nsec += DC_WAIT_MS * 1000000L;
+    until.tv_sec += until.tv_nsec / 1000000000L;
+    until.tv_nsec %= 1000000000L;
+    while (*building && pthread_cond_timedwait(&dc_done, &dc_lock, &until) != ETIMEDOUT)
+        ;
+}
+
+// === Auto-complete helper ===
+/* Completes the last word against the names in the tab's directory, or in
+   the directory named by the word's "dir/" part; a first word without a
+   '/' completes to a command on $PATH. */
+static void autocomplete(Tab *t)
+{
+    if (t->input_len == 0)
+        return;
+
+    char *start = strrchr(t->input, ' ');
+    char *word = start ? start + 1 : t->input;
+
+    if (strlen(word) == 0)
+        return;
+
+    char *slash = strrchr(word, '/');
+    char *prefix = slash ? slash + 1 : word;
+    size_t plen = strlen(prefix);
+    char dir[PATH_MAX];
+    if (!slash)
+        snprintf(dir, sizeof(dir), "%s", t->cwd);
+    else if (word[0] == '/')
+        snprintf(dir, sizeof(dir), "%.*s", slash == word ? 1 : (int)(slash - word), word);
+    else if (snprintf(dir, sizeof(dir), "%s/%.*s", t->cwd, (int)(slash - word), word) >= (int)sizeof(dir))
+        return; // longer than any path can be
+
+    pthread_mutex_lock(&dc_lock);
+    const NameList *nl;
+    const char *source;
+    int building;
+    if (!start && !slash)
+    {
+        path_index_check();
+        if (path_index.building)
+            dc_wait(&path_index.building); // a fresh index is usually a moment away
+        nl = &path_index.list;
+        source = "$PATH";
+        building = path_index.building;
+    }
+    else
+    {
+        dc_check();
+        DirCache *dc = dc_slot(dir);
+        if (!dc)
+        {
+            pthread_mutex_unlock(&dc_lock);
+            return;
+        }
+        dc_refresh(dc);
+        if (dc->building)
+            dc_wait(&dc->building); // otherwise the old snapshot is used
+        nl = &dc->list;
+        source = dc->path;
+        building = dc->building;
+    }
+    if (building && !nl->names)
+    {
+        char msg[PATH_MAX + 64];
+        snprintf(msg, sizeof(msg), "Indexing %s, press Tab again", source);
+        pthread_mutex_unlock(&dc_lock);
+        tb_append(&t->tb, msg);
+        ui_needs_redraw = 1;
+        return;
+    }
+
+    int lo, hi;
+    name_range(nl, prefix, plen, &lo, &hi);
+    int match_count = hi - lo;
+    size_t room = INPUT_MAX - (prefix - t->input);
+
+    if (match_count == 0)
+    {
+        pthread_mutex_unlock(&dc_lock);
+        return;
+    }
+
+    // === Case 1: Single match ===
+    if (match_count == 1)
+    {
+        snprintf(prefix, room, "%s", nl->names[lo]);
+        t->input_len = strlen(t->input);
+        t->cursor_pos = t->input_len;
+
+        char msg[256];
+        snprintf(msg, sizeof(msg), "Auto-completed: %s", nl->names[lo]);
+        tb_append(&t->tb, msg);
+        ui_needs_redraw = 1;
+    }
+    else
+    {
+        // === Case 2: Multiple matches — extend to their longest common prefix ===
+        size_t prefix_len = name_lcp(nl, lo, hi);
+
+        if (prefix_len > plen)
+        {
+            snprintf(prefix, room, "%.*s", (int)prefix_len, nl->names[lo]);
+            t->input_len = strlen(t->input);
+            t->cursor_pos = t->input_len;
+            tb_append(&t->tb, "Partial auto-complete (multiple matches)");
+        }
+        else
+        {
+            // === Case 3: Still multiple choices — list them ===
+            // the lookup is unbounded, the listing is not
+            tb_append(&t->tb, "Multiple matches:");
+            int shown = match_count < AC_LIST_MAX ? match_count : AC_LIST_MAX;
+            for (int i = lo; i < lo + shown; i++)
+            {
+                char msg[256];
+                snprintf(msg, sizeof(msg), "%d. %s", i - lo + 1, nl->names[i]);
+                tb_append(&t->tb, msg);
+            }
+            if (match_count > shown)
+            {
+                char msg[64];
+                snprintf(msg, sizeof(msg), "... and %d more", match_count - shown);
+                tb_append(&t->tb, msg);
+            }
+            tb_append(&t->tb, "Enter number to select file:");
+            ui_needs_redraw = 1;
+            // You can later extend this to let the user type a number
+        }
+    }
+    pthread_mutex_unlock(&dc_lock);
+}
+
+// ===== Process launcher =====
+/* Children are started with posix_spawn rather than fork + exec, so a
+   launch costs the same however large the GUI process has grown: glibc
+   implements it with a vfork-style clone that shares our address space
+   until the exec, and macOS does it in the kernel. Redirection files are
+   opened by the caller (so errors can be reported) and handed over with
+   the pipe ends as dup2 file actions. Every other descriptor we create is
+   close-on-exec. Normally the zygote below does the launching instead. */
+extern char **environ;
+
+// posix_spawn_file_actions_addchdir_np: macOS 10.15, glibc 2.29
+#if defined(__APPLE__) || (defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 29))
+#define SPAWN_HAS_CHDIR 1
+// not a POSIX name, so _XOPEN_SOURCE hides the declaration
+int posix_spawn_file_actions_addchdir_np(posix_spawn_file_actions_t *, const char *);
+#else
+#define SPAWN_HAS_CHDIR 0
+#endif
+
+typedef struct
+{
+    char *const *argv;
+    const char *path; // resolved executable, or NULL to search PATH
+    int fd[3];        // becomes the child's stdin/stdout/stderr; -1 = inherit ours
+    const char *cwd;  // the child's working directory, or NULL for ours
+} SpawnSpec;
+
+// Or'd into the errno spawn_cmd returns when the child could not enter sp->cwd
+#define SPAWN_ECWD 0x40000000
+
+// 0 if a child can be started in dir, else why not
+static int cwd_error(const char *dir)
+{
+    struct stat st;
+    if (stat(dir, &st) < 0)
+        return errno;
+    if (!S_ISDIR(st.st_mode))
+        return ENOTDIR;
+    return access(dir, X_OK) < 0 ? errno : 0;
+}
+
+/* pipe() with both ends close-on-exec. The UI and multiWatch threads
+   create pipes and spawn concurrently, so the flag must be set before any
+   other thread can launch a child: atomically with pipe2 where there is
+   one, otherwise with spawns locked out until fcntl is done. */
+#if defined(__linux__)
+#define HAVE_PIPE2 1
+int pipe2(int fds[2], int flags); // hidden by _XOPEN_SOURCE
+#else
+#define HAVE_PIPE2 0
+static pthread_mutex_t spawn_fd_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static int pipe_cloexec(int fds[2])
+{
+#if HAVE_PIPE2
+    return pipe2(fds, O_CLOEXEC);
+#else
+    pthread_mutex_lock(&spawn_fd_lock);
+    int ret = pipe(fds);
+    if (ret == 0)
+    {
+        fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    }
+    pthread_mutex_unlock(&spawn_fd_lock);
+    return ret;
+#endif
+}
+
+/* Spawn helper ("zygote"). main forks it before opening the display or
+   loading anything, so it is a tiny process with no X connection, job fds
+   or scrollback. Requests travel over a Unix socket: argv, environment,
+   working directory and resolved path in the payload, and the child's
+   stdin/stdout/stderr as SCM_RIGHTS descriptors. The zygote forks from its
+   own small address space, execs, and answers with the pid (or the errno
+   of a failed exec, passed back through a close-on-exec pipe). It reaps its
+   children and reports each exit on a pipe that the main loop polls. That
+   pipe is non-blocking on the zygote's side and records that do not fit
+   wait in a queue there: the main thread may be blocked in zygote_spawn,
+   waiting for a reply, so a zygote blocked on a full pipe would deadlock
+   both. If the zygote cannot be started or has died, spawn_cmd uses
+   posix_spawn. */
+typedef struct
+{
+    uint32_t len;       // payload bytes
+    int32_t argc, envc;
+    int32_t fd_mask;    // bit i: a descriptor for the child's fd i is attached
+} ZygoteReq;
+
+typedef struct
+{
+    pid_t pid;
+    int err;
+} ZygoteReply;
+
+typedef struct
+{
+    pid_t pid;
+    int status;
+    struct rusage ru;
+} ZygoteExit;
+
+static int zygote_sock = -1;   // requests and replies
+static int zygote_events = -1; // ZygoteExit records, read by the main loop
+static pthread_mutex_t zygote_lock = PTHREAD_MUTEX_INITIALIZER; // one request at a time
+static int zygote_sigchld[2] = {-1, -1};
+
+static int read_full(int fd, void *buf, size_t n)
+{
+    char *p = buf;
+    while (n > 0)
+    {
+        ssize_t r = read(fd, p, n);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return -1;
+        p += r;
+        n -= r;
+    }
+    return 0;
+}
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // macOS: the socket has SO_NOSIGPIPE instead
+#endif
+
+// Write all of buf to a pipe, or (sock) to a socket without raising SIGPIPE
+static int write_full(int fd, const void *buf, size_t n, int sock)
+{
+    const char *p = buf;
+    while (n > 0)
+    {
+        ssize_t w = sock ? send(fd, p, n, MSG_NOSIGNAL) : write(fd, p, n);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return -1;
+        p += w;
+        n -= w;
+    }
+    return 0;
+}
+
+static void zygote_on_sigchld(int sig)
+{
+    (void)sig;
+    int saved = errno;
+    (void)!write(zygote_sigchld[1], "x", 1);
+    errno = saved;
+}
+
+// Fork and exec one request; returns the reply
+static ZygoteReply zygote_exec(char *payload, const ZygoteReq *rq, const int *fds)
+{
+    ZygoteReply rep = {-1, 0};
+    char *path = payload, *cwd = path + strlen(path) + 1, *p = cwd + strlen(cwd) + 1;
+    char **argv = calloc(rq->argc + 1, sizeof(char *));
+    char **envp = calloc(rq->envc + 1, sizeof(char *));
+    int errpipe[2] = {-1, -1};
+    if (!argv || !envp || pipe_cloexec(errpipe) < 0)
+    {
+        rep.err = ENOMEM;
+        goto out;
+    }
+    for (int i = 0; i < rq->argc; i++, p += strlen(p) + 1)
+        argv[i] = p;
+    for (int i = 0; i < rq->envc; i++, p += strlen(p) + 1)
+        envp[i] = p;
+
+    rep.pid = fork();
+    if (rep.pid == 0)
+    {
+        for (int i = 0; i < 3; i++)
+            if (fds[i] >= 0)
+                dup2(fds[i], i);
+        int err = 0;
+        if (cwd[0] && chdir(cwd) < 0)
+            err = SPAWN_ECWD | errno;
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTSTP, SIG_DFL);
+        signal(SIGCHLD, SIG_DFL);
+        signal(SIGPIPE, SIG_DFL);
+        sigset_t none;
+        sigemptyset(&none);
+        sigprocmask(SIG_SETMASK, &none, NULL);
+        if (!err)
+        {
+            if (path[0])
+                execve(path, argv, envp); // falls through if it has gone since indexing
+            environ = envp;
+            execvp(argv[0], argv);
+            err = errno;
+        }
+        (void)!write(errpipe[1], &err, sizeof(err));
+        _exit(127);
+    }
+    if (rep.pid < 0)
+        rep.err = errno;
+    else
+    {
+        close(errpipe[1]);
+        errpipe[1] = -1;
+        int err;
+        if (read_full(errpipe[0], &err, sizeof(err)) == 0)
+        {
+            // exec failed: the parent never learns the pid, so reap it here
+            waitpid(rep.pid, NULL, 0);
+            rep.pid = -1;
+            rep.err = err;
         }
     }
+out:
+    if (errpipe[0] >= 0)
+        close(errpipe[0]);
+    if (errpipe[1] >= 0)
+        close(errpipe[1]);
+    free(argv);
+    free(envp);
+    return rep;
 }
-// === Auto-complete helper ===
-static void autocomplete(Tab *t)
-{
-    if (t->input_len == 0)
-        return;
 
-    char *start = strrchr(t->input, ' ');
-    const char *prefix = start ? start + 1 : t->input;
+// Exit records the events pipe had no room for, oldest first
+typedef struct
+{
+    ZygoteExit *rec;
+    size_t head, count, cap;
+} ZygoteQueue;
 
-    if (strlen(prefix) == 0)
-        return;
+// Write queued records until the pipe is full; each is under PIPE_BUF, so
+// a non-blocking write takes all of one or none of it
+static void zygote_flush(ZygoteQueue *q, int events)
+{
+    while (q->count > 0)
+    {
+        ssize_t w = write(events, &q->rec[q->head], sizeof(ZygoteExit));
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w < 0 && errno == EAGAIN)
+            return;
+        if (w < 0)
+            _exit(0); // the GUI has gone
+        q->head++;
+        q->count--;
+    }
+    q->head = 0;
+}
 
-    DIR *d = opendir(t->cwd);
-    if (!d)
-        return;
+static void zygote_queue(ZygoteQueue *q, const ZygoteExit *ex)
+{
+    if (q->head + q->count == q->cap)
+    {
+        if (q->head > 0)
+        {
+            memmove(q->rec, q->rec + q->head, q->count * sizeof(ZygoteExit));
+            q->head = 0;
+        }
+        else
+        {
+            size_t cap = q->cap ? q->cap * 2 : 64;
+            ZygoteExit *p = realloc(q->rec, cap * sizeof(ZygoteExit));
+            if (!p)
+                return; // drop it: the GUI will only miss this exit status
+            q->rec = p;
+            q->cap = cap;
+        }
+    }
+    q->rec[q->head + q->count++] = *ex;
+}
 
-    char *matches[256];
-    int match_count = 0;
+static void zygote_main(int sock, int events)
+{
+    // keep only the channel to the GUI and stdin/stdout/stderr
+    long maxfd = sysconf(_SC_OPEN_MAX);
+    for (int fd = 3; fd < (maxfd > 0 && maxfd < 4096 ? maxfd : 4096); fd++)
+        if (fd != sock && fd != events)
+            close(fd);
+    fcntl(sock, F_SETFD, FD_CLOEXEC);
+    fcntl(events, F_SETFD, FD_CLOEXEC);
+    set_nonblock(events);
+    ZygoteQueue queue = {0};
+    signal(SIGINT, SIG_IGN); // job control is the GUI's business
+    signal(SIGTSTP, SIG_IGN);
+    signal(SIGPIPE, SIG_IGN);
+    if (pipe_cloexec(zygote_sigchld) == 0)
+        set_nonblock(zygote_sigchld[0]);
+    signal(SIGCHLD, zygote_on_sigchld);
 
-    struct dirent *de;
-    while ((de = readdir(d)) != NULL && match_count < 256)
+    for (;;)
     {
-        if (strncmp(de->d_name, prefix, strlen(prefix)) == 0)
+        struct pollfd pfd[3] = {{sock, POLLIN, 0}, {zygote_sigchld[0], POLLIN, 0},
+                                {events, queue.count ? POLLOUT : 0, 0}};
+        if (poll(pfd, 3, -1) < 0 && errno != EINTR)
+            _exit(1);
+        if (pfd[1].revents)
+        {
+            char drain[64];
+            while (read(zygote_sigchld[0], drain, sizeof(drain)) > 0)
+                ;
+            ZygoteExit ex;
+            while ((ex.pid = wait4(-1, &ex.status, WNOHANG, &ex.ru)) > 0)
+                zygote_queue(&queue, &ex);
+        }
+        if (pfd[2].revents & (POLLERR | POLLHUP))
+            _exit(0); // the GUI has gone
+        zygote_flush(&queue, events);
+        if (!pfd[0].revents)
+            continue;
+
+        ZygoteReq rq;
+        int fds[3] = {-1, -1, -1}, got[3], ngot = 0;
+        char cbuf[CMSG_SPACE(3 * sizeof(int))];
+        struct iovec iov = {&rq, sizeof(rq)};
+        struct msghdr msg = {0};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = cbuf;
+        msg.msg_controllen = sizeof(cbuf);
+        ssize_t r = recvmsg(sock, &msg, MSG_WAITALL);
+        if (r == 0 || (r < 0 && errno != EINTR))
+            _exit(0); // the GUI has gone
+        if (r < 0)
+            continue;
+        for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c))
+            if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS)
+                for (size_t i = 0; i < (c->cmsg_len - CMSG_LEN(0)) / sizeof(int) && ngot < 3; i++)
+                {
+                    memcpy(&got[ngot], CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+                    fcntl(got[ngot++], F_SETFD, FD_CLOEXEC); // the child gets only its dup2'd copies
+                }
+        for (int i = 0, k = 0; i < 3; i++)
+            if (rq.fd_mask & (1 << i) && k < ngot)
+                fds[i] = got[k++];
+
+        ZygoteReply rep = {-1, EINVAL};
+        char *payload = r == sizeof(rq) ? malloc(rq.len + 1) : NULL;
+        if (payload && read_full(sock, payload, rq.len) == 0)
         {
-            matches[match_count++] = strdup(de->d_name);
+            payload[rq.len] = '\0';
+            rep = zygote_exec(payload, &rq, fds);
         }
+        else if (r != sizeof(rq) || (payload && rq.len))
+            _exit(1); // lost the framing
+        free(payload);
+        for (int i = 0; i < ngot; i++)
+            close(got[i]);
+        if (write_full(sock, &rep, sizeof(rep), 1) < 0)
+            _exit(0);
     }
-    closedir(d);
+}
 
-    if (match_count == 0)
+// Fork the zygote; call first thing in main, while the process is small
+static void zygote_start(void)
+{
+    int sv[2], ev[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
         return;
-
-    // === Case 1: Single match ===
-    if (match_count == 1)
+    if (pipe(ev) < 0)
     {
-        char completion[PATH_MAX];
-        strcpy(completion, t->input);
-        if (start)
-            strcpy(start + 1, matches[0]);
-        else
-            strcpy(t->input, matches[0]);
-        t->input_len = strlen(t->input);
-        t->cursor_pos = t->input_len;
-
-        char msg[256];
-        snprintf(msg, sizeof(msg), "Auto-completed: %s", matches[0]);
-        tb_append(&t->tb, msg);
-        ui_needs_redraw = 1;
+        close(sv[0]);
+        close(sv[1]);
+        return;
     }
-    else
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(sv[0]);
+        close(ev[0]);
+        zygote_main(sv[1], ev[1]);
+        _exit(0);
+    }
+    close(sv[1]);
+    close(ev[1]);
+    if (pid < 0)
     {
-        // === Case 2: Multiple matches — find longest common prefix ===
-        int prefix_len = strlen(matches[0]);
-        for (int i = 1; i < match_count; i++)
+        close(sv[0]);
+        close(ev[0]);
+        return;
+    }
+    zygote_sock = sv[0];
+    zygote_events = ev[0];
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(zygote_sock, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+    fcntl(zygote_sock, F_SETFD, FD_CLOEXEC);
+    fcntl(zygote_events, F_SETFD, FD_CLOEXEC);
+    set_nonblock(zygote_events);
+}
+
+/* Launch through the zygote. Returns 0 or an errno value; -1 when the
+   zygote is unavailable and the caller should spawn locally. */
+static int zygote_spawn(const SpawnSpec *sp, pid_t *pid)
+{
+    int argc = 0, envc = 0;
+    size_t len = 0;
+    char dir[PATH_MAX] = "";
+    if (sp->cwd)
+        snprintf(dir, sizeof(dir), "%s", sp->cwd);
+    else if (!getcwd(dir, sizeof(dir)))
+        dir[0] = '\0';
+    const char *path = sp->path ? sp->path : "";
+    len += strlen(path) + 1 + strlen(dir) + 1;
+    for (; sp->argv[argc]; argc++)
+        len += strlen(sp->argv[argc]) + 1;
+    for (; environ[envc]; envc++)
+        len += strlen(environ[envc]) + 1;
+    char *payload = malloc(len), *p = payload;
+    if (!payload)
+        return ENOMEM;
+    p = stpcpy(p, path) + 1;
+    p = stpcpy(p, dir) + 1;
+    for (int i = 0; i < argc; i++)
+        p = stpcpy(p, sp->argv[i]) + 1;
+    for (int i = 0; i < envc; i++)
+        p = stpcpy(p, environ[i]) + 1;
+
+    ZygoteReq rq = {(uint32_t)len, argc, envc, 0};
+    int fds[3], nfds = 0;
+    for (int i = 0; i < 3; i++)
+        if (sp->fd[i] >= 0)
         {
-            int j = 0;
-            while (j < prefix_len && matches[0][j] == matches[i][j])
-                j++;
-            prefix_len = j;
+            rq.fd_mask |= 1 << i;
+            fds[nfds++] = sp->fd[i];
         }
+    char cbuf[CMSG_SPACE(3 * sizeof(int))];
+    memset(cbuf, 0, sizeof(cbuf));
+    struct iovec iov = {&rq, sizeof(rq)};
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (nfds)
+    {
+        msg.msg_control = cbuf;
+        msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+        struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+        memcpy(CMSG_DATA(c), fds, nfds * sizeof(int));
+    }
 
-        if (prefix_len > strlen(prefix))
+    int ret = -1;
+    ZygoteReply rep;
+    pthread_mutex_lock(&zygote_lock);
+    if (zygote_sock >= 0)
+    {
+        ssize_t w;
+        do
+            w = sendmsg(zygote_sock, &msg, MSG_NOSIGNAL);
+        while (w < 0 && errno == EINTR);
+        if (w == (ssize_t)sizeof(rq) && write_full(zygote_sock, payload, len, 1) == 0 &&
+            read_full(zygote_sock, &rep, sizeof(rep)) == 0)
         {
-            // Extend the typed text to longest common prefix
-            char common[PATH_MAX];
-            strncpy(common, matches[0], prefix_len);
-            common[prefix_len] = '\0';
-            if (start)
-            {
-                strcpy(start + 1, common);
-            }
-            else
-            {
-                strcpy(t->input, common);
-            }
-            t->input_len = strlen(t->input);
-            t->cursor_pos = t->input_len;
-            tb_append(&t->tb, "Partial auto-complete (multiple matches)");
+            *pid = rep.pid;
+            ret = rep.err;
         }
         else
         {
-            // === Case 3: Still multiple choices — list them ===
-            tb_append(&t->tb, "Multiple matches:");
-            for (int i = 0; i < match_count; i++)
+            // the zygote is gone (or out of step): spawn locally from now on
+            close(zygote_sock);
+            zygote_sock = -1;
+        }
+    }
+    pthread_mutex_unlock(&zygote_lock);
+    free(payload);
+    return ret;
+}
+
+/* The zygote has died. Its children were reparented to init and keep
+   running, but nobody will report their exit now: hang them up and mark
+   their jobs lost so the tabs retire them. Our own children (launched while
+   the zygote was unavailable) are told apart by wait4, which fails with
+   ECHILD only for pids that are not ours. */
+static int zygote_orphan(pid_t pid, Tab *tabs, int tab_count, int *tab_ready)
+{
+    int st;
+    struct rusage ru;
+    pid_t r = wait4(pid, &st, WNOHANG, &ru);
+    if (r == pid)
+        job_exited(tabs, tab_count, pid, st, &ru, tab_ready);
+    if (r >= 0 || errno != ECHILD)
+        return 0;
+    kill(pid, SIGHUP);
+    return 1;
+}
+
+static void zygote_lost(Tab *tabs, int tab_count, int *tab_ready)
+{
+    for (int ti = 0; ti < tab_count; ti++)
+        for (int j = 0; j < tabs[ti].job_count; j++)
+        {
+            Job *job = &tabs[ti].jobs[j];
+            if (!job->active || job->exited)
+                continue;
+            for (int s = 0; s < job->nstages; s++)
+                if (job->stage_pids[s] > 0 && zygote_orphan(job->stage_pids[s], tabs, tab_count, tab_ready))
+                    job->stage_pids[s] = -1;
+            if (!job->exited && zygote_orphan(job->pid, tabs, tab_count, tab_ready))
             {
-                char msg[256];
-                snprintf(msg, sizeof(msg), "%d. %s", i + 1, matches[i]);
-                tb_append(&t->tb, msg);
+                job->exited = job->lost = 1;
+                tab_ready[ti] = 1;
             }
-            tb_append(&t->tb, "Enter number to select file:");
-            ui_needs_redraw = 1;
-            // You can later extend this to let the user type a number
         }
+}
+
+/* Main loop: pass the exits the zygote reported to the jobs. Tabs holding a
+   finished job are flagged in tab_ready. */
+static void zygote_reap(Tab *tabs, int tab_count, int *tab_ready)
+{
+    ZygoteExit ex;
+    ssize_t r;
+    while ((r = read(zygote_events, &ex, sizeof(ex))) == (ssize_t)sizeof(ex))
+        job_exited(tabs, tab_count, ex.pid, ex.status, &ex.ru, tab_ready);
+    if (r == 0)
+    {
+        close(zygote_events);
+        zygote_events = -1;
+        zygote_lost(tabs, tab_count, tab_ready);
+    }
+}
+
+
+// Returns 0 and sets *pid, or an errno value
+static int spawn_cmd(const SpawnSpec *sp, pid_t *pid)
+{
+    if (!sp->argv[0])
+        return EINVAL;
+    int zerr = zygote_spawn(sp, pid);
+    if (zerr >= 0)
+        return zerr;
+    // a missing cwd would otherwise look like a missing command (ENOENT)
+    int dir_err = sp->cwd ? cwd_error(sp->cwd) : 0;
+    if (dir_err)
+        return SPAWN_ECWD | dir_err;
+    posix_spawn_file_actions_t fa;
+    posix_spawnattr_t attr;
+    if (posix_spawn_file_actions_init(&fa) != 0)
+        return ENOMEM;
+    if (posix_spawnattr_init(&attr) != 0)
+    {
+        posix_spawn_file_actions_destroy(&fa);
+        return ENOMEM;
     }
+    for (int i = 0; i < 3; i++)
+        if (sp->fd[i] >= 0)
+            posix_spawn_file_actions_adddup2(&fa, sp->fd[i], i);
+#if SPAWN_HAS_CHDIR
+    if (sp->cwd)
+        posix_spawn_file_actions_addchdir_np(&fa, sp->cwd);
+#endif
 
-    for (int i = 0; i < match_count; i++)
-        free(matches[i]);
+    // a clean signal state, whatever thread launches it
+    sigset_t none, def;
+    sigemptyset(&none);
+    sigemptyset(&def);
+    sigaddset(&def, SIGINT);
+    sigaddset(&def, SIGTSTP);
+    sigaddset(&def, SIGCHLD);
+    sigaddset(&def, SIGPIPE);
+    posix_spawnattr_setsigmask(&attr, &none);
+    posix_spawnattr_setsigdefault(&attr, &def);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    int err = ENOENT;
+#if !HAVE_PIPE2
+    pthread_mutex_lock(&spawn_fd_lock);
+#endif
+#if !SPAWN_HAS_CHDIR
+    // no chdir file action: borrow the process directory for the launch
+    static pthread_mutex_t cwd_lock = PTHREAD_MUTEX_INITIALIZER;
+    int here = -1;
+    pthread_mutex_lock(&cwd_lock);
+    if (sp->cwd && ((here = open(".", O_RDONLY | O_CLOEXEC)) < 0 || chdir(sp->cwd) < 0))
+        dir_err = errno;
+#endif
+    if (!dir_err && sp->path)
+        err = posix_spawn(pid, sp->path, &fa, &attr, sp->argv, environ);
+    if (!dir_err && err == ENOENT && sp->cwd)
+        dir_err = cwd_error(sp->cwd); // removed since the check above?
+    if (!dir_err && err == ENOENT) // not resolved, or gone since it was indexed
+        err = posix_spawnp(pid, sp->argv[0], &fa, &attr, sp->argv, environ);
+#if !SPAWN_HAS_CHDIR
+    if (here >= 0)
+    {
+        (void)!fchdir(here);
+        close(here);
+    }
+    pthread_mutex_unlock(&cwd_lock);
+#endif
+#if !HAVE_PIPE2
+    pthread_mutex_unlock(&spawn_fd_lock);
+#endif
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&fa);
+    return dir_err ? SPAWN_ECWD | dir_err : err;
 }
 
 // ===== MultiWatch Thread =====
+// The worker owns no UI state: it appends under ui_lock and wakes the loop.
+static void mw_post(Tab *t, const char *s)
+{
+    pthread_mutex_lock(&ui_lock);
+    tb_append(&t->tb, s);
+    ui_needs_redraw = 1;
+    pthread_mutex_unlock(&ui_lock);
+    wake_loop();
+}
+
 void *multiwatch_thread(void *arg)
 {
     MultiWatchArgs *mw = (MultiWatchArgs *)arg;
     Tab *t = mw->tab;
     char buf[4096];
-    tb_append(&t->tb, "multiWatch started (refresh every 2s)...");
-    ui_needs_redraw = 1;
+    mw_post(t, "multiWatch started (refresh every 2s)...");
 
     while (multiwatch_active)
     {
         for (int i = 0; i < mw->ncmds; i++)
         {
             int pipefd[2];
-            if (pipe(pipefd) < 0)
+            if (pipe_cloexec(pipefd) < 0)
                 continue;
 
-            pid_t pid = fork();
-            if (pid == 0)
+            char *argv[] = {"sh", "-c", mw->cmds[i], NULL};
+            char exe[PATH_MAX];
+            SpawnSpec sp = {argv, path_resolve("sh", exe, sizeof(exe)) ? exe : NULL,
+                            {-1, pipefd[1], pipefd[1]}, mw->cwd};
+            pid_t pid;
+            if (spawn_cmd(&sp, &pid) != 0)
             {
-                // --- CHILD ---
-                dup2(pipefd[1], STDOUT_FILENO);
-                dup2(pipefd[1], STDERR_FILENO);
                 close(pipefd[0]);
                 close(pipefd[1]);
-                execlp("sh", "sh", "-c", mw->cmds[i], NULL);
-                _exit(127);
             }
-            else if (pid > 0)
+            else
             {
-                // --- PARENT ---
                 close(pipefd[1]);
                 ssize_t r;
                 // 🔁 Keep reading until EOF (so no output is missed)
@@ -573,225 +4659,864 @@ void *multiwatch_thread(void *arg)
                     snprintf(label, sizeof(label),
                              "%s --- %s ---\n%s",
                              timebuf, mw->cmds[i], buf);
-                    tb_append(&t->tb, label);
-                    ui_needs_redraw = 1;
+                    mw_post(t, label);
                 }
+                // no waitpid: the main loop's reaper collects every child
+                // (this one matches no job), and a second waiter here could
+                // take the status of a job that reused the pid
                 close(pipefd[0]);
-                waitpid(pid, NULL, 0);
             }
         }
 
-        tb_append(&t->tb, "------ refresh complete ------");
-        ui_needs_redraw = 1;
-        sleep(2);
+        mw_post(t, "------ refresh complete ------");
+        sleep(2);
+    }
+
+    mw_post(t, "multiWatch stopped.");
+    free(mw);
+    return NULL;
+}
+
+// ===== Tabs =====
+static unsigned long long scrollback_budget = (unsigned long long)DEFAULT_SCROLLBACK_MB << 20;
+static unsigned long long view_clock; // ticks each time the active tab is drawn
+static int create_tab(Tab *tabs, int *tab_count, int *active)
+{
+    if (*tab_count >= MAX_TABS)
+        return -1;
+    static int next_tab_id = 1;
+    Tab *t = &tabs[*tab_count];
+    t->id = next_tab_id++;
+    tb_init(&t->tb);
+    t->seen_version = 0;
+    t->last_viewed = ++view_clock;
+    t->input_len = 0;
+    t->input[0] = '\0';
+    t->job_count = 0;
+    t->fg_pid = -1;
+    t->jobs_pending = 0;
+    t->job_rr = 0;
+    t->scroll_offset = 0;
+    t->multiline_mode = 0;
+    t->hist_index = -1;
+    t->cursor_pos = 0;
+    t->search_mode = 0;
+    t->search_buf[0] = '\0';
+    t->search_len = 0;
+    memset(&t->finder, 0, sizeof(t->finder));
+    memset(&t->find, 0, sizeof(t->find));
+    t->find.cur = -1;
+    getcwd(t->cwd, sizeof(t->cwd));
+    dc_prefetch(t->cwd);
+    snprintf(t->title, sizeof(t->title), "tab %d", *tab_count + 1);
+    tb_append(&t->tb, "New tab created.");
+    load_history(t);
+    (*tab_count)++;
+    if (*active == -1)
+        *active = 0;
+    return *tab_count - 1;
+}
+
+static void close_tab(Tab *tabs, int *tab_count, int *active, int idx)
+{
+    if (idx < 0 || idx >= *tab_count)
+        return;
+    for (int j = 0; j < tabs[idx].job_count; ++j)
+        if (tabs[idx].jobs[j].active)
+        {
+            kill(tabs[idx].jobs[j].pid, SIGKILL);
+            if (tabs[idx].jobs[j].master_fd >= 0)
+                close(tabs[idx].jobs[j].master_fd);
+        }
+    tb_free(&tabs[idx].tb);
+    find_free(&tabs[idx].find);
+    hf_close(&tabs[idx].finder);
+    // the closed tab's commands become part of every tab's history
+    for (int h = 0; h < shared_hist.count; h++)
+        if (shared_hist.sess[h] == tabs[idx].id)
+            shared_hist.sess[h] = 0;
+    for (int k = idx; k < *tab_count - 1; ++k)
+        tabs[k] = tabs[k + 1];
+    (*tab_count)--;
+    if (*tab_count == 0)
+        *active = -1;
+    else if (*active >= *tab_count)
+        *active = *tab_count - 1;
+}
+
+/* Keep all scrollback within scrollback_budget. While over it, compact the
+   least recently viewed tab that still has memory to give back; the active
+   tab is never touched. */
+static void enforce_scrollback_budget(Tab *tabs, int tab_count, int active)
+{
+    unsigned long long total = 0;
+    for (int i = 0; i < tab_count; i++)
+        total += tb_memory(&tabs[i].tb);
+
+    int done[MAX_TABS] = {0};
+    while (total > scrollback_budget)
+    {
+        int victim = -1;
+        for (int i = 0; i < tab_count; i++)
+            if (i != active && !done[i] && (victim < 0 || tabs[i].last_viewed < tabs[victim].last_viewed))
+                victim = i;
+        if (victim < 0)
+            break;
+        done[victim] = 1;
+        unsigned long long before = tb_memory(&tabs[victim].tb);
+        tb_compact(&tabs[victim].tb);
+        total -= before - tb_memory(&tabs[victim].tb);
+    }
+}
+
+// ===== Drawing (damage-tracked; multiline typing fixed) =====
+static int font_h = 16, font_ascent = 12, margin = 8; // font_h: ascent + descent + leading
+static XFontStruct *font; // queried once at startup; widths are computed client-side
+static int win_w = WIN_W, win_h = WIN_H; // tracked from ConfigureNotify, no round trips
+
+static void load_font(Display *dpy, GC gc)
+{
+    const char *name = getenv("MYTERM_FONT");
+    font = XLoadQueryFont(dpy, name ? name : "fixed");
+    if (!font && name)
+        font = XLoadQueryFont(dpy, "fixed");
+    if (font)
+        XSetFont(dpy, gc, font->fid);
+    else
+        font = XQueryFont(dpy, XGContextFromGC(gc)); // metrics of the server default
+    if (font)
+    {
+        font_ascent = font->ascent;
+        font_h = font->ascent + font->descent + 2;
+    }
+}
+
+/* What the window currently shows. draw_ui diffs the tabs against this
+   snapshot and repaints only the regions (tab bar, output rows, input line)
+   that actually changed. */
+typedef struct
+{
+    int valid; // 0 forces a full repaint (Expose, first frame)
+    int tab_count, active, tab_id;
+    char titles[MAX_TABS][64];
+    int unread[MAX_TABS];
+    int scroll_offset;
+    unsigned long long first_seq, end_seq, version; // output rows on screen
+    char prompt[PATH_MAX + 64];
+    char input[INPUT_MAX];
+    int input_len, cursor_pos, search_mode;
+    char search_buf[256];
+    unsigned long long find_gen, finder_gen;
+} FrameState;
+
+static FrameState shown;
+
+/* Frames are composed off-screen in a Pixmap and the damaged band is copied
+   to the window once per frame, so the window never shows a half-drawn
+   frame and Expose is served straight from the last finished one. */
+static Pixmap back = None;
+static GC bg_gc; // fills with the background colour
+static int back_w, back_h;
+static int damage_y0, damage_y1; // rows of back touched this frame
+
+static void invalidate_ui(void)
+{
+    shown.valid = 0;
+    ui_needs_redraw = 1;
+}
+
+static void damage(int y0, int y1)
+{
+    if (y0 < damage_y0)
+        damage_y0 = y0;
+    if (y1 > damage_y1)
+        damage_y1 = y1;
+}
+
+static void clear_area(Display *dpy, int x, int y, int w, int h)
+{
+    XFillRectangle(dpy, back, bg_gc, x, y, w, h);
+    damage(y, y + h);
+}
+
+// (Re)create the back buffer when the window size changes; returns 1 if new
+static int ensure_backbuffer(Display *dpy, Window win, int w, int h)
+{
+    if (back != None && back_w == w && back_h == h)
+        return 0;
+    if (back == None)
+    {
+        bg_gc = XCreateGC(dpy, win, 0, NULL);
+        XSetForeground(dpy, bg_gc, WhitePixel(dpy, DefaultScreen(dpy)));
+    }
+    else
+        XFreePixmap(dpy, back);
+    back = XCreatePixmap(dpy, win, w, h, DefaultDepth(dpy, DefaultScreen(dpy)));
+    back_w = w;
+    back_h = h;
+    return 1;
+}
+
+// Expose: copy the exposed rectangle from the last finished frame
+static int present_exposed(Display *dpy, Window win, GC gc, const XExposeEvent *ex)
+{
+    if (back == None || !shown.valid)
+        return 0;
+    XCopyArea(dpy, back, win, gc, ex->x, ex->y, ex->width, ex->height, ex->x, ex->y);
+    return 1;
+}
+
+// Output rows that fit between the tab bar and the three-row input area
+static int view_rows(int height)
+{
+    int limit = height - TAB_HEIGHT - 2 * margin - 3 * font_h;
+    return limit > 0 ? limit / font_h : 0;
+}
+
+static int row_top(int r) { return TAB_HEIGHT + margin + r * font_h; }
+static int row_baseline(int r) { return row_top(r) + 1 + font_ascent; }
+
+/* Text rendering. With XRender, each codepoint is rasterized once through an XFontSet,
+   uploaded to a server-side GlyphSet and from then on drawn by id; a block of
+   output rows costs one XRenderCompositeText32 request. Without the extension
+   text falls back to core XDrawString. */
+#define MAX_CODEPOINT 0x110000
+#define GLYPH_PM_W 1024 // scratch strip for rasterizing a batch of new glyphs
+
+static int use_render;
+static Display *glyph_dpy;
+static XFontSet fontset;
+static GlyphSet glyphs;
+static Picture back_pic = None, pen_black, pen_white;
+static unsigned char *glyph_adv; // advance + 1 of each uploaded codepoint, 0 = not yet
+static Pixmap glyph_pm;
+static GC glyph_gc;
+static unsigned *cp_buf; // decode scratch
+static int cp_cap;
+
+static void init_glyphs(Display *dpy, Window win)
+{
+    int ev, err, major = 0, minor = 0;
+    if (!XRenderQueryExtension(dpy, &ev, &err) || !XRenderQueryVersion(dpy, &major, &minor) ||
+        (major == 0 && minor < 10))
+        return;
+    const char *name = getenv("MYTERM_FONT");
+    char **missing;
+    int nmissing;
+    char *def;
+    fontset = XCreateFontSet(dpy, name ? name : "fixed", &missing, &nmissing, &def);
+    if (missing)
+        XFreeStringList(missing);
+    if (!fontset)
+        return;
+
+    XFontSetExtents *ext = XExtentsOfFontSet(fontset);
+    font_ascent = -ext->max_logical_extent.y;
+    font_h = ext->max_logical_extent.height + 2;
+
+    glyphs = XRenderCreateGlyphSet(dpy, XRenderFindStandardFormat(dpy, PictStandardA8));
+    XRenderColor black = {0, 0, 0, 0xffff}, white = {0xffff, 0xffff, 0xffff, 0xffff};
+    pen_black = XRenderCreateSolidFill(dpy, &black);
+    pen_white = XRenderCreateSolidFill(dpy, &white);
+    glyph_pm = XCreatePixmap(dpy, win, GLYPH_PM_W, font_h, 1);
+    glyph_gc = XCreateGC(dpy, glyph_pm, 0, NULL);
+    glyph_adv = calloc(MAX_CODEPOINT, 1);
+    glyph_dpy = dpy;
+    use_render = glyph_adv != NULL;
+}
+
+// Point the render target at a freshly created back buffer
+static void bind_back_picture(Display *dpy)
+{
+    if (!use_render)
+        return;
+    if (back_pic != None)
+        XRenderFreePicture(dpy, back_pic);
+    back_pic = XRenderCreatePicture(dpy, back,
+                                    XRenderFindVisualFormat(dpy, DefaultVisual(dpy, DefaultScreen(dpy))),
+                                    0, NULL);
+}
+
+// Decode UTF-8 into codepoints; bytes that are not valid UTF-8 map to Latin-1
+static int utf8_decode(const char *s, int len, unsigned *out)
+{
+    const unsigned char *p = (const unsigned char *)s, *end = p + len;
+    int n = 0;
+    while (p < end)
+    {
+        unsigned c = *p++;
+        int extra = c >= 0xf8 ? 0 : c >= 0xf0 ? 3 : c >= 0xe0 ? 2 : c >= 0xc0 ? 1 : 0;
+        if (extra && end - p >= extra)
+        {
+            unsigned v = c & (0x3f >> extra);
+            int k = 0;
+            while (k < extra && (p[k] & 0xc0) == 0x80)
+                v = (v << 6) | (p[k++] & 0x3f);
+            if (k == extra && v < MAX_CODEPOINT)
+            {
+                c = v;
+                p += extra;
+            }
+        }
+        out[n++] = c;
+    }
+    return n;
+}
+
+static unsigned *decode_scratch(int len)
+{
+    if (len > cp_cap)
+    {
+        cp_cap = len * 2;
+        cp_buf = realloc(cp_buf, sizeof(unsigned) * cp_cap);
+    }
+    return cp_buf;
+}
+
+/* Upload every codepoint in cps that the GlyphSet does not have yet. New
+   glyphs are drawn side by side into a 1-bit strip and read back with one
+   XGetImage per strip, then added as A8 glyphs in one request. */
+static void ensure_glyphs(const unsigned *cps, int n)
+{
+    Display *dpy = glyph_dpy;
+    Glyph ids[64];
+    XGlyphInfo info[64];
+    int xs[64], count = 0, x = 0;
+
+    for (int i = 0; i <= n; i++)
+    {
+        char u8[4];
+        int u8len = 0, w = 0, adv = 0;
+        if (i < n)
+        {
+            unsigned cp = cps[i];
+            if (glyph_adv[cp])
+                continue;
+            int dup = 0;
+            for (int j = 0; j < count; j++)
+                dup |= ids[j] == cp;
+            if (dup)
+                continue;
+            if (cp < 0x80)
+                u8[u8len++] = cp;
+            else if (cp < 0x800)
+            {
+                u8[u8len++] = 0xc0 | (cp >> 6);
+                u8[u8len++] = 0x80 | (cp & 0x3f);
+            }
+            else if (cp < 0x10000)
+            {
+                u8[u8len++] = 0xe0 | (cp >> 12);
+                u8[u8len++] = 0x80 | ((cp >> 6) & 0x3f);
+                u8[u8len++] = 0x80 | (cp & 0x3f);
+            }
+            else
+            {
+                u8[u8len++] = 0xf0 | (cp >> 18);
+                u8[u8len++] = 0x80 | ((cp >> 12) & 0x3f);
+                u8[u8len++] = 0x80 | ((cp >> 6) & 0x3f);
+                u8[u8len++] = 0x80 | (cp & 0x3f);
+            }
+            adv = (cp < 0x20 || cp == 0x7f) ? 0 : Xutf8TextEscapement(fontset, u8, u8len);
+            if (adv < 0)
+                adv = 0;
+            if (adv > 254)
+                adv = 254;
+            w = adv > 0 ? adv : 1;
+            if (w > GLYPH_PM_W)
+                w = GLYPH_PM_W;
+        }
+
+        // flush the strip when it is full or at the end
+        if (count > 0 && (i == n || x + w > GLYPH_PM_W || count == 64))
+        {
+            XImage *img = XGetImage(dpy, glyph_pm, 0, 0, x, font_h, 1, ZPixmap);
+            int total = 0;
+            for (int j = 0; j < count; j++)
+                total += ((info[j].width + 3) & ~3) * font_h;
+            char *data = calloc(total ? total : 1, 1), *q = data;
+            for (int j = 0; j < count; j++)
+            {
+                int stride = (info[j].width + 3) & ~3;
+                for (int yy = 0; yy < font_h; yy++)
+                    for (int xx = 0; xx < info[j].width; xx++)
+                        if (img && XGetPixel(img, xs[j] + xx, yy))
+                            q[yy * stride + xx] = (char)0xff;
+                q += stride * font_h;
+                glyph_adv[ids[j]] = info[j].xOff + 1;
+            }
+            XRenderAddGlyphs(dpy, glyphs, ids, info, count, data, total);
+            free(data);
+            if (img)
+                XDestroyImage(img);
+            count = 0;
+            x = 0;
+        }
+        if (i == n)
+            break;
+
+        if (x == 0)
+        {
+            XSetForeground(dpy, glyph_gc, 0);
+            XFillRectangle(dpy, glyph_pm, glyph_gc, 0, 0, GLYPH_PM_W, font_h);
+            XSetForeground(dpy, glyph_gc, 1);
+        }
+        Xutf8DrawString(dpy, glyph_pm, fontset, glyph_gc, x, 1 + font_ascent, u8, u8len);
+        ids[count] = cps[i];
+        info[count].width = w;
+        info[count].height = font_h;
+        info[count].x = 0;
+        info[count].y = 1 + font_ascent;
+        info[count].xOff = adv;
+        info[count].yOff = 0;
+        xs[count++] = x;
+        x += w;
     }
+}
 
-    tb_append(&t->tb, "multiWatch stopped.");
-    ui_needs_redraw = 1;
-    free(mw);
-    return NULL;
+static int text_width(const char *s, int len)
+{
+    if (!use_render)
+        return font ? XTextWidth(font, s, len) : len * 8;
+    unsigned *cps = decode_scratch(len);
+    int n = utf8_decode(s, len, cps), w = 0;
+    ensure_glyphs(cps, n);
+    for (int i = 0; i < n; i++)
+        w += glyph_adv[cps[i]] - 1;
+    return w;
 }
 
-// ===== Tabs =====
-static int create_tab(Tab *tabs, int *tab_count, int *active)
+static Picture pen_for(Display *dpy, GC gc)
 {
-    if (*tab_count >= MAX_TABS)
-        return -1;
-    Tab *t = &tabs[*tab_count];
-    tb_init(&t->tb);
-    t->input_len = 0;
-    t->input[0] = '\0';
-    t->job_count = 0;
-    t->scroll_offset = 0;
-    t->multiline_mode = 0;
-    t->hist_count = 0;
-    t->hist_index = -1;
-    t->cursor_pos = 0;
-    t->search_mode = 0;
-    t->search_buf[0] = '\0';
-    t->search_len = 0;
-    getcwd(t->cwd, sizeof(t->cwd));
-    snprintf(t->title, sizeof(t->title), "tab %d", *tab_count + 1);
-    tb_append(&t->tb, "New tab created.");
-    load_history(t);
-    (*tab_count)++;
-    if (*active == -1)
-        *active = 0;
-    return *tab_count - 1;
+    XGCValues v;
+    XGetGCValues(dpy, gc, GCForeground, &v); // served from Xlib's GC cache
+    return v.foreground == WhitePixel(dpy, DefaultScreen(dpy)) ? pen_white : pen_black;
 }
 
-static void close_tab(Tab *tabs, int *tab_count, int *active, int idx)
+static void draw_text(Display *dpy, GC gc, int x, int y, const char *s, int len)
 {
-    if (idx < 0 || idx >= *tab_count)
+    if (len <= 0)
         return;
-    for (int j = 0; j < tabs[idx].job_count; ++j)
-        if (tabs[idx].jobs[j].active)
+    if (!use_render)
+    {
+        XDrawString(dpy, back, gc, x, y, s, len);
+        return;
+    }
+    unsigned *cps = decode_scratch(len);
+    int n = utf8_decode(s, len, cps);
+    ensure_glyphs(cps, n);
+    XRenderCompositeString32(dpy, PictOpOver, pen_for(dpy, gc), back_pic, None, glyphs,
+                             0, 0, x, y, cps, n);
+}
+
+/* Draw lines start + r0 .. start + r1 - 1 of a buffer at rows r0..r1-1 as one
+   batched text request; each row is clipped to the window width first. */
+static void draw_text_rows(Display *dpy, GC gc, TextBuffer *tb, int start, int r0, int r1, int width)
+{
+    if (!use_render)
+    {
+        for (int r = r0; r < r1 && start + r < tb_total_lines(tb); r++)
         {
-            kill(tabs[idx].jobs[j].pid, SIGKILL);
-            if (tabs[idx].jobs[j].master_fd >= 0)
-                close(tabs[idx].jobs[j].master_fd);
+            int llen;
+            const char *line = tb_view_line(tb, start + r, &llen);
+            XDrawString(dpy, back, gc, margin, row_baseline(r), line, llen);
         }
-    tb_free(&tabs[idx].tb);
-    for (int k = idx; k < *tab_count - 1; ++k)
-        tabs[k] = tabs[k + 1];
-    (*tab_count)--;
-    if (*tab_count == 0)
-        *active = -1;
-    else if (*active >= *tab_count)
-        *active = *tab_count - 1;
+        return;
+    }
+
+    XGlyphElt32 elts[r1 - r0 > 0 ? r1 - r0 : 1];
+    int total = 0, nelts = 0;
+    for (int r = r0; r < r1 && start + r < tb_total_lines(tb); r++)
+    {
+        int llen;
+        tb_view_line(tb, start + r, &llen);
+        total += llen < width ? llen : width;
+    }
+    unsigned *cps = decode_scratch(total + 1);
+    int used = 0, pen_x = 0, pen_y = 0;
+    for (int r = r0; r < r1 && start + r < tb_total_lines(tb); r++)
+    {
+        int llen;
+        const char *line = tb_view_line(tb, start + r, &llen);
+        if (llen > width) // no glyph is narrower than a pixel
+            llen = width;
+        int n = utf8_decode(line, llen, cps + used);
+        ensure_glyphs(cps + used, n);
+        int adv = 0, keep = 0;
+        while (keep < n && margin + adv < width)
+            adv += glyph_adv[cps[used + keep++]] - 1;
+        if (keep == 0)
+            continue;
+        elts[nelts].glyphset = glyphs;
+        elts[nelts].chars = cps + used;
+        elts[nelts].nchars = keep;
+        elts[nelts].xOff = margin - pen_x;
+        elts[nelts].yOff = row_baseline(r) - pen_y;
+        nelts++;
+        pen_x = margin + adv;
+        pen_y = row_baseline(r);
+        used += keep;
+    }
+    if (nelts > 0)
+        XRenderCompositeText32(dpy, PictOpOver, pen_for(dpy, gc), back_pic, None, 0, 0,
+                               0, 0, elts, nelts);
 }
 
-// ===== Drawing (multiline typing fixed) =====
-static void draw_ui(Display *dpy, Window win, GC gc, Tab *tabs, int tab_count, int active)
+static void draw_tabbar(Display *dpy, GC gc, Tab *tabs, int tab_count, int active,
+                        const int *unread, int width)
 {
-    XWindowAttributes wa;
-    XGetWindowAttributes(dpy, win, &wa);
-    XClearWindow(dpy, win);
-
-    // TAB BAR
+    clear_area(dpy, 0, 0, width, TAB_HEIGHT);
+    int text_y = (TAB_HEIGHT + font_ascent - (font_h - 2 - font_ascent)) / 2;
+    int close_x = TAB_WIDTH - 12 - text_width("x", 1);
     for (int i = 0; i < tab_count; i++)
     {
         int x = i * TAB_WIDTH;
+        char title[68];
+        snprintf(title, sizeof(title), "%s%s", unread[i] ? "* " : "", tabs[i].title);
         if (i == active)
         {
-            XFillRectangle(dpy, win, gc, x + 2, 2, TAB_WIDTH - 6, TAB_HEIGHT - 6);
+            XFillRectangle(dpy, back, gc, x + 2, 2, TAB_WIDTH - 6, TAB_HEIGHT - 6);
             XSetForeground(dpy, gc, WhitePixel(dpy, DefaultScreen(dpy)));
-            XDrawString(dpy, win, gc, x + 8, 18, tabs[i].title, strlen(tabs[i].title));
-            XDrawString(dpy, win, gc, x + TAB_WIDTH - 18, 16, "x", 1);
+            draw_text(dpy, gc, x + 8, text_y, title, strlen(title));
+            draw_text(dpy, gc, x + close_x, text_y, "x", 1);
             XSetForeground(dpy, gc, BlackPixel(dpy, DefaultScreen(dpy)));
         }
         else
         {
-            XDrawRectangle(dpy, win, gc, x + 2, 2, TAB_WIDTH - 6, TAB_HEIGHT - 6);
-            XDrawString(dpy, win, gc, x + 8, 18, tabs[i].title, strlen(tabs[i].title));
-            XDrawString(dpy, win, gc, x + TAB_WIDTH - 18, 16, "x", 1);
+            XDrawRectangle(dpy, back, gc, x + 2, 2, TAB_WIDTH - 6, TAB_HEIGHT - 6);
+            draw_text(dpy, gc, x + 8, text_y, title, strlen(title));
+            draw_text(dpy, gc, x + close_x, text_y, "x", 1);
         }
     }
 
     // "+" Button
     int plus_x = tab_count * TAB_WIDTH + 8;
-    XDrawRectangle(dpy, win, gc, plus_x, 4, 32, TAB_HEIGHT - 8);
-    XDrawString(dpy, win, gc, plus_x + 10, 18, "+", 1);
+    XDrawRectangle(dpy, back, gc, plus_x, 4, 32, TAB_HEIGHT - 8);
+    draw_text(dpy, gc, plus_x + (32 - text_width("+", 1)) / 2, text_y, "+", 1);
+}
 
-    if (active >= 0 && active < tab_count)
+// Repaint output rows [r0, r1) showing lines start, start + 1, ...
+/* Ctrl+F highlights: each match on rows r0..r1-1 gets a filled box behind
+   its text, the selected hit a stronger one. Falls back to outlines when the
+   colours cannot be allocated. */
+static GC find_gc[2];
+static int find_outline;
+
+static void draw_find_marks(Display *dpy, GC gc, Tab *t, int start, int r0, int r1, int width)
+{
+    FindState *fs = &t->find;
+    if (!fs->active || fs->nhits == 0)
+        return;
+    if (!find_gc[0])
     {
-        Tab *t = &tabs[active];
-        int font_h = 16, margin = 8;
-
-        // Output area
-        int y = TAB_HEIGHT + margin + font_h;
-        int visible = (wa.height - TAB_HEIGHT - margin * 3) / font_h;
-
-        // Ensure scroll_offset never exceeds content height
-        if (t->scroll_offset > t->tb.line_count - visible)
-            t->scroll_offset = t->tb.line_count - visible;
-        if (t->scroll_offset < 0)
-            t->scroll_offset = 0;
-
-        // Auto-scroll: if at bottom (scroll_offset == 0), always follow new output
-        int start = t->tb.line_count - visible - t->scroll_offset;
-        if (start < 0)
-            start = 0;
-        int end = t->tb.line_count - t->scroll_offset;
-        if (end < start)
-            end = start;
-
-        if (end < start)
-            end = start;
-        for (int i = start; i < end && y < wa.height - 3 * font_h; i++, y += font_h)
-            XDrawString(dpy, win, gc, margin, y, t->tb.lines[i], strlen(t->tb.lines[i]));
-
-        int base_y = wa.height - margin - font_h;
-        int cur_y = base_y;
-
-        // === Search mode UI (Ctrl+R active) ===
-        if (t->search_mode)
-        {
-            char search_prompt[INPUT_MAX + 64];
-            snprintf(search_prompt, sizeof(search_prompt), "Search: %s", t->search_buf);
-            XDrawString(dpy, win, gc, margin, cur_y, search_prompt, strlen(search_prompt));
-
-            // show preview of current best match dynamically
-            int best_idx = -1;
-            int best_len = 0;
-            char term[256];
-            strncpy(term, t->search_buf, sizeof(term) - 1);
-            term[sizeof(term) - 1] = '\0';
-            int len = strlen(term);
-
-            if (len > 0)
-            {
-                for (int i = t->hist_count - 1; i >= 0; i--)
-                {
-                    if (strstr(t->history[i], term))
-                    {
-                        best_idx = i;
-                        best_len = len;
-                        break;
-                    }
-                }
-            }
+        const char *names[2] = {"khaki", "orange"};
+        for (int i = 0; i < 2; i++)
+        {
+            XColor c, exact;
+            find_gc[i] = XCreateGC(dpy, back, 0, NULL);
+            if (XAllocNamedColor(dpy, DefaultColormap(dpy, DefaultScreen(dpy)), names[i], &c, &exact))
+                XSetForeground(dpy, find_gc[i], c.pixel);
+            else
+                find_outline = 1;
+        }
+    }
+
+    static char *copy;
+    static int copy_cap;
+    for (int r = r0; r < r1; r++)
+    {
+        int line = start + r;
+        int k = find_lower_bound(fs->hits, fs->nhits, line);
+        if (k == fs->nhits || fs->hits[k] != line)
+            continue;
+        int len;
+        const char *s = tb_view_line(&t->tb, line, &len);
+        if (len > width)
+            len = width;
+        if (len + 1 > copy_cap)
+        {
+            char *p = realloc(copy, len + 1);
+            if (!p)
+                return;
+            copy = p;
+            copy_cap = len + 1;
+        }
+        memcpy(copy, s, len);
+        copy[len] = '\0';
 
-            if (best_idx >= 0)
+        GC mark = find_outline ? gc : find_gc[k == fs->cur];
+        for (int pos = 0; pos <= len;)
+        {
+            int so, eo;
+            if (fs->regex)
             {
-                char preview[INPUT_MAX + 64];
-                snprintf(preview, sizeof(preview), "Match: %s", t->history[best_idx]);
-                XDrawString(dpy, win, gc, margin, cur_y + font_h, preview, strlen(preview));
+                regmatch_t pm;
+                if (regexec(&fs->re, copy + pos, 1, &pm, pos > 0 ? REG_NOTBOL : 0) != 0)
+                    break;
+                so = pos + pm.rm_so;
+                eo = pos + pm.rm_eo;
             }
-            else if (len > 0)
+            else
             {
-                XDrawString(dpy, win, gc, margin, cur_y + font_h, "No match found.", 15);
+                const char *hit = find_sub(copy + pos, len - pos, fs->query, fs->qlen);
+                if (!hit)
+                    break;
+                so = hit - copy;
+                eo = so + fs->qlen;
             }
+            int x = margin + text_width(copy, so), w = text_width(copy + so, eo - so);
+            if (find_outline)
+                XDrawRectangle(dpy, back, mark, x, row_top(r), w > 1 ? w - 1 : 1, font_h - 1);
+            else
+                XFillRectangle(dpy, back, mark, x, row_top(r), w > 2 ? w : 2, font_h);
+            pos = eo > so ? eo : eo + 1;
+        }
+    }
+}
+
+static void draw_rows(Display *dpy, GC gc, Tab *t, int start, int r0, int r1, int width)
+{
+    if (r0 >= r1)
+        return;
+    clear_area(dpy, 0, row_top(r0), width, (r1 - r0) * font_h);
+    draw_find_marks(dpy, gc, t, start, r0, r1, width);
+    draw_text_rows(dpy, gc, &t->tb, start, r0, r1, width);
+}
+
+static void draw_input(Display *dpy, GC gc, Tab *t, const char *prompt, int top, int width, int height)
+{
+    clear_area(dpy, 0, top, width, height - top);
+    int base_y = top + 1 + font_ascent;
+    int cur_y = base_y;
+
+    // === Scrollback search UI (Ctrl+F active) ===
+    if (t->find.active)
+    {
+        const FindState *fs = &t->find;
+        char line[512];
+        snprintf(line, sizeof(line), "Find%s: %s", fs->regex ? " (regex)" : "", fs->query);
+        draw_text(dpy, gc, margin, cur_y, line, strlen(line));
+        int qx = margin + text_width(line, strlen(line));
+        XDrawLine(dpy, back, gc, qx, cur_y - font_ascent, qx, cur_y + font_h - 2 - font_ascent);
+
+        if (fs->bad_regex)
+            snprintf(line, sizeof(line), "Invalid regular expression.");
+        else if (fs->task && (fs->searched_regex != fs->regex || strcmp(fs->searched, fs->query)))
+            snprintf(line, sizeof(line), "Searching...");
+        else if (fs->qlen > 0 && fs->nhits == 0)
+            snprintf(line, sizeof(line), "No matches.");
+        else if (fs->qlen > 0)
+            snprintf(line, sizeof(line), "Match %d of %d", fs->cur + 1, fs->nhits);
+        else
+            line[0] = '\0';
+        draw_text(dpy, gc, margin, cur_y + font_h, line, strlen(line));
+        const char *hint = "Enter/Up: older  Down: newer  Tab: regex  Esc: close";
+        draw_text(dpy, gc, margin, cur_y + 2 * font_h, hint, strlen(hint));
+        return;
+    }
+
+    // === Search mode UI (Ctrl+R active): query, ranked list, hint ===
+    if (t->search_mode)
+    {
+        HistFinder *hf = &t->finder;
+        char line[INPUT_MAX + 64];
+        snprintf(line, sizeof(line), "Search: %s", t->search_buf);
+        draw_text(dpy, gc, margin, cur_y, line, strlen(line));
+        snprintf(line, sizeof(line), "%d of %d", hf->nmatch, hf->nids);
+        int w = text_width(line, strlen(line));
+        draw_text(dpy, gc, width - margin - w, cur_y, line, strlen(line));
 
-            // Draw hint line
-            XDrawString(dpy, win, gc, margin, cur_y + 3 * font_h,
-                        "Press Enter to select, ESC to cancel", 36);
-            return; // only draw search UI, skip normal input UI
+        int list = hf_list_rows(view_rows(height));
+        if (hf->sel < hf->top)
+            hf->top = hf->sel;
+        if (hf->sel >= hf->top + list)
+            hf->top = hf->sel - list + 1;
+        for (int i = 0; i < list && hf->top + i < hf->nmatch; i++)
+        {
+            int k = hf->ranked[hf->top + i];
+            snprintf(line, sizeof(line), "%s %s", hf->top + i == hf->sel ? ">" : " ",
+                     hidx_text(&shared_hist.hidx, hf->ids[k]));
+            draw_text(dpy, gc, margin, cur_y + (i + 1) * font_h, line, strlen(line));
         }
+        if (hf->nmatch == 0 && t->search_len > 0)
+            draw_text(dpy, gc, margin, cur_y + font_h, "No match found.", strlen("No match found."));
 
-        // === Normal input UI (non-search) ===
-        char prompt[PATH_MAX + 64];
-        snprintf(prompt, sizeof(prompt), "%s%s> ",
-                 t->multiline_mode ? "(multi) " : "", t->cwd);
-        int prompt_width = strlen(prompt) * 8;
-        XDrawString(dpy, win, gc, margin, cur_y, prompt, strlen(prompt));
-        int line_x = margin + prompt_width;
+        const char *hint = "Up/Down to choose, Enter to select, ESC to cancel";
+        draw_text(dpy, gc, margin, cur_y + (list + 1) * font_h, hint, strlen(hint));
+        return; // only draw search UI, skip normal input UI
+    }
+
+    // === Normal input UI (non-search) ===
+    int prompt_width = text_width(prompt, strlen(prompt));
+    draw_text(dpy, gc, margin, cur_y, prompt, strlen(prompt));
+    int line_x = margin + prompt_width;
 
-        int line_start = 0;
-        for (int i = 0; i < t->input_len; i++)
+    int line_start = 0;
+    int cursor_x = line_x, cursor_y = cur_y;
+    for (int i = 0; i < t->input_len; i++)
+    {
+        if (i == t->cursor_pos)
         {
-            if (t->input[i] == '\n')
-            {
-                char temp = t->input[i];
-                t->input[i] = '\0';
-                XDrawString(dpy, win, gc, line_x, cur_y, &t->input[line_start],
-                            strlen(&t->input[line_start]));
-                t->input[i] = temp;
-                line_start = i + 1;
-                cur_y += font_h;
-                line_x = margin + 20;
-            }
+            cursor_x = line_x + text_width(&t->input[line_start], i - line_start);
+            cursor_y = cur_y;
+        }
+        if (t->input[i] == '\n')
+        {
+            draw_text(dpy, gc, line_x, cur_y, &t->input[line_start], i - line_start);
+            line_start = i + 1;
+            cur_y += font_h;
+            line_x = margin + 20;
+        }
+    }
+    if (t->cursor_pos >= t->input_len)
+    {
+        cursor_x = line_x + text_width(&t->input[line_start], t->input_len - line_start);
+        cursor_y = cur_y;
+    }
+
+    if (line_start < t->input_len)
+        draw_text(dpy, gc, line_x, cur_y,
+                    &t->input[line_start], t->input_len - line_start);
+
+    if (t->multiline_mode)
+        draw_text(dpy, gc, margin + 20, cur_y + font_h,
+                    "↳ multiline input active", strlen("↳ multiline input active"));
+
+    // --- Draw cursor position ---
+    XDrawLine(dpy, back, gc, cursor_x, cursor_y - font_ascent, cursor_x, cursor_y + font_h - 2 - font_ascent);
+}
+
+// Output rows and input line of the active tab
+static void draw_tab_view(Display *dpy, GC gc, Tab *t, int width, int height, int full)
+{
+    int rows = view_rows(height);
+    if (t->search_mode) // the Ctrl+R list grows the input area upwards
+        rows -= hf_list_rows(rows) - 1;
+
+    // Ensure scroll_offset never exceeds content height
+    int total = tb_total_lines(&t->tb);
+    if (t->scroll_offset > total - rows)
+        t->scroll_offset = total - rows;
+    if (t->scroll_offset < 0)
+        t->scroll_offset = 0;
+
+    // Auto-scroll: if at bottom (scroll_offset == 0), always follow new output
+    int start = total - rows - t->scroll_offset;
+    if (start < 0)
+        start = 0;
+    unsigned long long first_seq = t->tb.seq - total + start;
+
+    // OUTPUT ROWS: when following the tail, scroll the rows already on screen
+    // with XCopyArea and paint only the ones holding new or changed lines.
+    if (full || t->scroll_offset != 0 || t->scroll_offset != shown.scroll_offset ||
+        t->find.gen != shown.find_gen || t->search_mode != shown.search_mode || first_seq < shown.first_seq || first_seq - shown.first_seq >= (unsigned long long)rows)
+        draw_rows(dpy, gc, t, start, 0, rows, width);
+    else if (t->tb.version != shown.version)
+    {
+        int shift = (int)(first_seq - shown.first_seq);
+        if (shift > 0)
+        {
+            XCopyArea(dpy, back, back, gc, 0, row_top(shift), width, (rows - shift) * font_h, 0, row_top(0));
+            damage(row_top(0), row_top(rows));
         }
+        // the previous last line may have grown, so repaint from its row down
+        long r0 = shown.end_seq > 0 ? (long)(shown.end_seq - 1 - first_seq) : 0;
+        if (r0 < 0)
+            r0 = 0;
+        draw_rows(dpy, gc, t, start, (int)r0, rows, width);
+    }
+    shown.scroll_offset = t->scroll_offset;
+    shown.first_seq = first_seq;
+    shown.end_seq = t->tb.seq;
+    shown.version = t->tb.version;
+    t->seen_version = t->tb.version;
+    t->last_viewed = ++view_clock;
+    t->tb.warm.budget = WARM_BUDGET; // lifted again if the tab was compacted
 
-        if (line_start < t->input_len)
-            XDrawString(dpy, win, gc, line_x, cur_y,
-                        &t->input[line_start], strlen(&t->input[line_start]));
+    // INPUT LINE: only when the prompt, typed text or cursor changed
+    char prompt[PATH_MAX + 64];
+    snprintf(prompt, sizeof(prompt), "%s%s> ",
+             t->multiline_mode ? "(multi) " : "", t->cwd);
+    if (full || strcmp(prompt, shown.prompt) != 0 || t->input_len != shown.input_len ||
+        memcmp(t->input, shown.input, t->input_len) != 0 || t->cursor_pos != shown.cursor_pos ||
+        t->search_mode != shown.search_mode || strcmp(t->search_buf, shown.search_buf) != 0 ||
+        t->find.gen != shown.find_gen || t->finder.gen != shown.finder_gen)
+    {
+        draw_input(dpy, gc, t, prompt, row_top(rows), width, height);
+        strcpy(shown.prompt, prompt);
+        memcpy(shown.input, t->input, t->input_len);
+        shown.input_len = t->input_len;
+        shown.cursor_pos = t->cursor_pos;
+        shown.search_mode = t->search_mode;
+        strcpy(shown.search_buf, t->search_buf);
+        shown.finder_gen = t->finder.gen;
+    }
+    shown.find_gen = t->find.gen;
+}
 
-        if (t->multiline_mode)
-            XDrawString(dpy, win, gc, margin + 20, cur_y + font_h,
-                        "↳ multiline input active", 25);
+static void draw_ui(Display *dpy, Window win, GC gc, Tab *tabs, int tab_count, int active)
+{
+    int cur_id = (active >= 0 && active < tab_count) ? tabs[active].id : -1;
+    int full = !shown.valid || cur_id != shown.tab_id;
+    if (ensure_backbuffer(dpy, win, win_w, win_h))
+    {
+        bind_back_picture(dpy);
+        full = 1;
+    }
+    damage_y0 = win_h;
+    damage_y1 = 0;
+    if (full)
+        clear_area(dpy, 0, 0, win_w, win_h);
 
-        // --- Draw cursor position ---
-        int cursor_x = margin + prompt_width + (t->cursor_pos * 8);
-        int cursor_y = cur_y;
-        XDrawLine(dpy, win, gc, cursor_x, cursor_y - 12, cursor_x, cursor_y + 3);
+    // TAB BAR: only when tabs, titles or unread markers changed
+    int unread[MAX_TABS];
+    int tabs_dirty = full || tab_count != shown.tab_count || active != shown.active;
+    for (int i = 0; i < tab_count; i++)
+    {
+        unread[i] = i != active && tabs[i].tb.version != tabs[i].seen_version;
+        if (unread[i] != shown.unread[i] || strcmp(tabs[i].title, shown.titles[i]) != 0)
+            tabs_dirty = 1;
     }
+    if (tabs_dirty)
+    {
+        draw_tabbar(dpy, gc, tabs, tab_count, active, unread, win_w);
+        for (int i = 0; i < tab_count; i++)
+        {
+            shown.unread[i] = unread[i];
+            strcpy(shown.titles[i], tabs[i].title);
+        }
+    }
+    shown.tab_count = tab_count;
+    shown.active = active;
+    shown.tab_id = cur_id;
+    shown.valid = 1;
+
+    if (active >= 0 && active < tab_count)
+        draw_tab_view(dpy, gc, &tabs[active], win_w, win_h, full);
+
+    // present: one blit of the damaged band per frame
+    if (damage_y0 < damage_y1)
+        XCopyArea(dpy, back, win, gc, 0, damage_y0, win_w, damage_y1 - damage_y0, 0, damage_y0);
 }
 
 // ===== Command execution (with async background fix) =====
 
 #include <glob.h>
 
+/* Relative names in a command are relative to the tab's cwd, not to
+   MyTerm's. Returns the length of the prefix added to name (0 if none). */
+static size_t tab_path(const Tab *t, const char *name, char *out, size_t n)
+{
+    if (name[0] == '/' || name[0] == '~')
+    {
+        snprintf(out, n, "%s", name);
+        return 0;
+    }
+    int pre = snprintf(out, n, "%s%s", t->cwd, strcmp(t->cwd, "/") == 0 ? "" : "/");
+    snprintf(out + pre, n - pre, "%s", name);
+    return pre;
+}
+
 static void run_command(Tab *t)
 {
     t->input[t->input_len] = '\0';
@@ -801,15 +5526,8 @@ static void run_command(Tab *t)
     tb_append(&t->tb, t->input);
 
     // ---- Command History ----
-    if (t->hist_count < MAX_HISTORY)
-        t->history[t->hist_count++] = strdup(t->input);
-    else
-    {
-        free(t->history[0]);
-        memmove(&t->history[0], &t->history[1], sizeof(char *) * (MAX_HISTORY - 1));
-        t->history[MAX_HISTORY - 1] = strdup(t->input);
-    }
-    save_history(t);
+    hist_add(t->id, t->input);
+    journal_append(t->input);
     t->hist_index = -1;
     t->scroll_offset = 0;
 
@@ -846,9 +5564,21 @@ static void run_command(Tab *t)
                 path = expanded;
             }
         }
-        if (chdir(path) == 0)
+        // only the tab moves: its children are started in t->cwd
+        char full[PATH_MAX], real[PATH_MAX];
+        struct stat st;
+        int err = 0;
+        tab_path(t, path, full, sizeof(full));
+        if (!realpath(full, real) || stat(real, &st) < 0)
+            err = errno;
+        else if (!S_ISDIR(st.st_mode))
+            err = ENOTDIR;
+        else if (access(real, X_OK) < 0)
+            err = errno;
+        if (!err)
         {
-            getcwd(t->cwd, sizeof(t->cwd));
+            snprintf(t->cwd, sizeof(t->cwd), "%s", real);
+            dc_prefetch(t->cwd);
             char msg[PATH_MAX + 32];
             snprintf(msg, sizeof(msg), "Changed directory to: %s", t->cwd);
             tb_append(&t->tb, msg);
@@ -856,20 +5586,45 @@ static void run_command(Tab *t)
         else
         {
             char msg[PATH_MAX + 64];
-            snprintf(msg, sizeof(msg), "cd: No such file or directory: %s", path);
+            snprintf(msg, sizeof(msg), "cd: %s: %s", strerror(err), path);
             tb_append(&t->tb, msg);
         }
         return;
     }
 
+    if (strcmp(cmdline, "stats") == 0)
+    {
+        const TextBuffer *tb = &t->tb;
+        unsigned long long hot = 0;
+        for (int i = 0; i < TB_CHUNKS; i++)
+            hot += tb->chunks[i] ? TB_CHUNK_SIZE : 0;
+        char line[256];
+        snprintf(line, sizeof(line), "hot:  %d lines, %llu KB arena", tb->line_count, hot >> 10);
+        tb_append(&t->tb, line);
+        snprintf(line, sizeof(line), "warm: %d lines in %d blocks, %llu KB -> %llu KB (%.1fx)",
+                 warm_count(&tb->warm), tb->warm.nblocks, tb->warm.rawbytes >> 10, tb->warm.zbytes >> 10,
+                 tb->warm.zbytes ? (double)tb->warm.rawbytes / tb->warm.zbytes : 0.0);
+        tb_append(&t->tb, line);
+        snprintf(line, sizeof(line), "cold: %d lines, %llu KB on disk", tb->cold.count, tb->cold.size >> 10);
+        tb_append(&t->tb, line);
+        return;
+    }
+
     // ---- Built-ins: jobs / kill / fg ----
     if (strncmp(cmdline, "history", 7) == 0)
     {
-        int start = (t->hist_count > 1000) ? t->hist_count - 1000 : 0;
-        for (int i = start; i < t->hist_count; i++)
+        // the last 1000 entries of this tab's view
+        hist_wait();
+        int start = shared_hist.count, shown = 0;
+        while (start > 0 && shown < 1000)
+            if (hist_visible(t, shared_hist.hidx.base + --start))
+                shown++;
+        for (int i = start; i < shared_hist.count; i++)
         {
+            if (!hist_visible(t, shared_hist.hidx.base + i))
+                continue;
             char line[INPUT_MAX + 32];
-            snprintf(line, sizeof(line), "%4d  %s", i + 1, t->history[i]);
+            snprintf(line, sizeof(line), "%4d  %s", i + 1, shared_hist.items[i]);
             tb_append(&t->tb, line);
         }
         return;
@@ -901,13 +5656,18 @@ static void run_command(Tab *t)
         pid_t pid = atoi(cmdline + 3);
         if (pid > 0)
         {
-            tb_append(&t->tb, "Bringing job to foreground...");
-            int st;
-            waitpid(pid, &st, 0);
-            tb_append(&t->tb, "Foreground job finished.");
+            int found = 0;
             for (int i = 0; i < t->job_count; i++)
-                if (t->jobs[i].pid == pid)
-                    t->jobs[i].active = 0;
+                if (t->jobs[i].active && t->jobs[i].pid == pid)
+                    found = 1;
+            if (!found)
+            {
+                tb_append(&t->tb, "fg: no such job");
+                return;
+            }
+            tb_append(&t->tb, "Bringing job to foreground...");
+            t->fg_pid = pid;
+            kill(pid, SIGCONT);
         }
         else
             tb_append(&t->tb, "Usage: fg <pid>");
@@ -932,6 +5692,7 @@ static void run_command(Tab *t)
 
         MultiWatchArgs *mw = malloc(sizeof(MultiWatchArgs));
         mw->tab = t;
+        snprintf(mw->cwd, sizeof(mw->cwd), "%s", t->cwd);
         mw->ncmds = 0;
 
         char *saveptr;
@@ -997,7 +5758,7 @@ static void run_command(Tab *t)
 
     int pipes[15][2];
     for (int i = 0; i < ncmds - 1; i++)
-        if (pipe(pipes[i]) == -1)
+        if (pipe_cloexec(pipes[i]) == -1)
         {
             tb_append(&t->tb, "pipe() failed");
             return;
@@ -1005,7 +5766,7 @@ static void run_command(Tab *t)
 
     pid_t pids[16];
     int capture_pipe[2];
-    pipe(capture_pipe);
+    pipe_cloexec(capture_pipe);
 
     for (int i = 0; i < ncmds; i++)
     {
@@ -1043,11 +5804,14 @@ static void run_command(Tab *t)
                 {
                     glob_t g;
                     int flags = GLOB_TILDE | GLOB_NOCHECK;
-                    if (glob(tok, flags, NULL, &g) == 0)
+                    char pat[PATH_MAX];
+                    size_t pre = tab_path(t, tok, pat, sizeof(pat));
+                    if (glob(pat, flags, NULL, &g) == 0)
                     {
                         for (size_t gi = 0; gi < g.gl_pathc && argc < 127; gi++)
                         {
-                            argv[argc] = strdup(g.gl_pathv[gi]);
+                            // matches are listed as typed, relative to the tab
+                            argv[argc] = strdup(g.gl_pathv[gi] + pre);
                             dup_allocs[dup_count++] = argv[argc];
                             argc++;
                         }
@@ -1071,113 +5835,108 @@ static void run_command(Tab *t)
         }
         argv[argc] = NULL;
 
-        pid_t pid = fork();
-        if (pid == 0)
-        {
-            if (i > 0)
-                dup2(pipes[i - 1][0], STDIN_FILENO);
-            if (i < ncmds - 1)
-                dup2(pipes[i][1], STDOUT_FILENO);
-            else
-                dup2(capture_pipe[1], STDOUT_FILENO);
-
-            dup2(STDOUT_FILENO, STDERR_FILENO);
-
-            if (infile)
-            {
-                int fd = open(infile, O_RDONLY);
-                if (fd < 0)
-                    _exit(1);
-                dup2(fd, STDIN_FILENO);
-                close(fd);
-            }
-            if (outfile)
-            {
-                int fd = open(outfile,
-                              O_WRONLY | O_CREAT | (append_mode ? O_APPEND : O_TRUNC),
-                              0644);
-                if (fd < 0)
-                    _exit(1);
-                dup2(fd, STDOUT_FILENO);
-                dup2(fd, STDERR_FILENO);
-                close(fd);
-            }
+        char exe[PATH_MAX] = "";
+        path_resolve(argv[0], exe, sizeof(exe));
 
-            for (int j = 0; j < ncmds - 1; j++)
-            {
-                close(pipes[j][0]);
-                close(pipes[j][1]);
-            }
-            close(capture_pipe[0]);
-            close(capture_pipe[1]);
-            execvp(argv[0], argv);
-            _exit(127);
-        }
-        else if (pid > 0)
+        // stdout and stderr go down the pipe (the last stage's into the
+        // tab); < and > replace them with files opened here
+        int in_fd = i > 0 ? pipes[i - 1][0] : -1;
+        int out_fd = i < ncmds - 1 ? pipes[i][1] : capture_pipe[1];
+        int redir_in = -1, redir_out = -1, err = 0;
+        const char *what = argv[0];
+        char in_path[PATH_MAX], out_path[PATH_MAX];
+        if (infile)
+            tab_path(t, infile, in_path, sizeof(in_path));
+        if (outfile)
+            tab_path(t, outfile, out_path, sizeof(out_path));
+        if (infile && (redir_in = open(in_path, O_RDONLY | O_CLOEXEC)) < 0)
+            err = errno, what = infile;
+        if (!err && outfile &&
+            (redir_out = open(out_path, O_WRONLY | O_CREAT | O_CLOEXEC | (append_mode ? O_APPEND : O_TRUNC),
+                              0644)) < 0)
+            err = errno, what = outfile;
+        SpawnSpec sp = {argv, exe[0] ? exe : NULL,
+                        {redir_in >= 0 ? redir_in : in_fd, redir_out >= 0 ? redir_out : out_fd,
+                         redir_out >= 0 ? redir_out : out_fd},
+                        t->cwd};
+        pid_t pid = -1;
+        if (!err)
+            err = spawn_cmd(&sp, &pid);
+        if (redir_in >= 0)
+            close(redir_in);
+        if (redir_out >= 0)
+            close(redir_out);
+        if (err)
         {
-            pids[i] = pid;
-            for (int u = 0; u < dup_count; u++)
-                free(dup_allocs[u]);
-            if (i > 0)
-                close(pipes[i - 1][0]);
-            if (i < ncmds - 1)
-                close(pipes[i][1]);
-        }
-        else
-        {
-            tb_append(&t->tb, "fork failed");
-            for (int u = 0; u < dup_count; u++)
-                free(dup_allocs[u]);
+            // the rest of the pipeline still runs, as in a shell
+            char msg[2 * PATH_MAX + 64];
+            if (err & SPAWN_ECWD)
+                snprintf(msg, sizeof(msg), "%s: cannot run in %s: %s", what ? what : "(empty command)",
+                         t->cwd, strerror(err & ~SPAWN_ECWD));
+            else
+                snprintf(msg, sizeof(msg), "%s: %s", what ? what : "(empty command)",
+                         err == ENOENT && what == argv[0] ? "command not found" : strerror(err));
+            tb_append(&t->tb, msg);
             ui_needs_redraw = 1;
-            return;
         }
+        pids[i] = pid;
+        for (int u = 0; u < dup_count; u++)
+            free(dup_allocs[u]);
+        if (i > 0)
+            close(pipes[i - 1][0]);
+        if (i < ncmds - 1)
+            close(pipes[i][1]);
     }
 
     close(capture_pipe[1]);
-    fg_pid = pids[ncmds - 1];
+
+    // Both foreground and background pipelines become jobs; check_jobs streams
+    // their output into the tab while they run and reaps every stage.
+    pid_t last_pid = pids[ncmds - 1];
+    if (last_pid < 0)
+    {
+        // nothing to collect output from; earlier stages are reaped as they exit
+        close(capture_pipe[0]);
+        return;
+    }
+    Job *job = add_job(t, last_pid, capture_pipe[0], t->input);
+    if (!job)
+    {
+        tb_append(&t->tb, "Too many jobs in this tab; output will not be captured.");
+        close(capture_pipe[0]);
+        return;
+    }
+    for (int i = 0; i < ncmds - 1; i++)
+        job->stage_pids[job->nstages++] = pids[i];
 
     if (background)
     {
-        pid_t last_pid = pids[ncmds - 1];
-        add_job(t, last_pid, capture_pipe[0], t->input);
         char msg[256];
         snprintf(msg, sizeof(msg), "[%d] running in background", last_pid);
         tb_append(&t->tb, msg);
     }
     else
     {
-        char buf[4096];
-        set_nonblock(capture_pipe[0]);
-        int status;
-        for (int i = 0; i < ncmds; i++)
-            waitpid(pids[i], &status, 0);
-
-        while (1)
-        {
-            ssize_t r = read(capture_pipe[0], buf, sizeof(buf) - 1);
-            if (r > 0)
-            {
-                buf[r] = '\0';
-                tb_append(&t->tb, buf);
-            }
-            else
-                break;
-        }
-        close(capture_pipe[0]);
-        tb_append(&t->tb, "Command finished.");
-        t->scroll_offset = 0; // ✅ auto-scroll to bottom
-        ui_needs_redraw = 1;  // ✅ force UI update
-        fg_pid = -1;
+        t->fg_pid = last_pid;
+        ui_needs_redraw = 1; // ✅ force UI update
     }
 }
 
 // ===== Main =====
 int main()
 {
+    zygote_start();
     setlocale(LC_CTYPE, "");
     // --- Register signal handlers (Part 9) ---
     signal(SIGINT, handle_sigint);
     signal(SIGTSTP, handle_sigtstp);
+    signal(SIGCHLD, handle_sigchld);
+    if (pipe(wake_pipe) == 0)
+        for (int i = 0; i < 2; i++)
+        {
+            set_nonblock(wake_pipe[i]);
+            fcntl(wake_pipe[i], F_SETFD, FD_CLOEXEC);
+        }
     Display *dpy = XOpenDisplay(NULL);
     if (!dpy)
     {
@@ -1193,30 +5952,146 @@ int main()
     XMapWindow(dpy, win);
     GC gc = XCreateGC(dpy, win, 0, NULL);
     XSetForeground(dpy, gc, BlackPixel(dpy, screen));
+    XSetGraphicsExposures(dpy, gc, False); // copies come from our own back buffer
+    load_font(dpy, gc);
+    init_glyphs(dpy, win);
     XStoreName(dpy, win, "MyTerm - Async Background Jobs");
 
+    path_index_prefetch();
     Tab tabs[MAX_TABS];
     int tab_count = 0, active = -1;
     create_tab(tabs, &tab_count, &active);
+    ui_needs_redraw = 1;
+
+    // Frame pacing: however many events arrive, draw at most once per frame
+    const char *fps_env = getenv("MYTERM_FPS");
+    int fps = fps_env ? atoi(fps_env) : DEFAULT_FPS;
+    if (fps <= 0)
+        fps = DEFAULT_FPS;
+    long long frame_ns = 1000000000LL / fps, next_frame_ns = 0;
 
+    const char *budget_env = getenv("MYTERM_SCROLLBACK_MB");
+    if (budget_env && atoi(budget_env) > 0)
+        scrollback_budget = (unsigned long long)atoi(budget_env) << 20;
+
+    static struct pollfd pfd[3 + MAX_TABS * MAX_JOBS];
+    static int pfd_tab[3 + MAX_TABS * MAX_JOBS];
+    int next_tab = 0; // background tab whose jobs are read first next turn
+    pthread_mutex_lock(&ui_lock);
     while (1)
     {
-        // Poll background jobs (reads their output into buffers)
-        if (active >= 0)
-            check_jobs(&tabs[active]);
-        // You may want to check jobs in all tabs; do it below:
+        // === Reactor: sleep until X input, job output, a signal or a worker wakeup ===
+        int nfds = 0;
+        pfd[nfds].fd = ConnectionNumber(dpy);
+        pfd[nfds++].events = POLLIN;
+        pfd[nfds].fd = wake_pipe[0];
+        pfd[nfds++].events = POLLIN;
+        pfd[nfds].fd = zygote_events; // ignored by poll once it is -1
+        pfd[nfds++].events = POLLIN;
+        for (int ti = 0; ti < tab_count; ++ti)
+            for (int j = 0; j < tabs[ti].job_count; ++j)
+                if (tabs[ti].jobs[j].active && tabs[ti].jobs[j].master_fd >= 0)
+                {
+                    pfd[nfds].fd = tabs[ti].jobs[j].master_fd;
+                    pfd[nfds].events = POLLIN;
+                    pfd_tab[nfds++] = ti;
+                }
+        for (int i = 0; i < nfds; i++)
+            pfd[i].revents = 0;
+
+        // With a redraw pending, sleep no later than the next frame slot;
+        // with job output left over from the last turn, do not sleep at all
+        int timeout_ms = -1;
+        if (ui_needs_redraw)
+        {
+            long long wait_ns = next_frame_ns - now_ns();
+            timeout_ms = wait_ns > 0 ? (int)((wait_ns + 999999) / 1000000) : 0;
+        }
         for (int ti = 0; ti < tab_count; ++ti)
-            check_jobs(&tabs[ti]);
+            if (tabs[ti].jobs_pending)
+                timeout_ms = 0;
+        XFlush(dpy);
+        if (!XPending(dpy) && !child_exited && !pending_sig && timeout_ms != 0)
+        {
+            pthread_mutex_unlock(&ui_lock);
+            poll(pfd, nfds, timeout_ms);
+            pthread_mutex_lock(&ui_lock);
+        }
+        else
+            poll(pfd, nfds, 0); // still learn which jobs have output
+        if (pfd[1].revents)
+        {
+            char drain[64];
+            while (read(wake_pipe[0], drain, sizeof(drain)) > 0)
+                ;
+        }
 
-        draw_ui(dpy, win, gc, tabs, tab_count, active);
+        // Read job output only from tabs whose fds fired, that own a child
+        // which has just been reaped, or that have output left over.
+        int tab_ready[MAX_TABS] = {0};
+        for (int i = 3; i < nfds; i++)
+            if (pfd[i].revents)
+                tab_ready[pfd_tab[i]] = 1;
+        for (int ti = 0; ti < tab_count; ++ti)
+            if (tabs[ti].jobs_pending)
+                tab_ready[ti] = 1;
+        if (pfd[2].revents)
+            zygote_reap(tabs, tab_count, tab_ready);
+        if (child_exited)
+        {
+            child_exited = 0;
+            reap_children(tabs, tab_count, tab_ready);
+        }
+        /* The active tab is read first and with a bigger budget; the others
+           take turns going first, and whichever tab the turn's time runs out
+           on leads the next one. The first tab is always read, so every tab
+           keeps moving however much the others print. */
+        int any_ready = 0;
+        long long deadline = now_ns() + JOB_TURN_NS;
+        if (active >= 0 && tab_ready[active])
+        {
+            check_jobs(&tabs[active], JOB_ACTIVE_BUDGET, deadline);
+            any_ready = 1;
+        }
+        int served = 0, late = 0, first = next_tab;
+        next_tab = tab_count ? (next_tab + 1) % tab_count : 0;
+        for (int n = 0; n < tab_count; ++n)
+        {
+            int ti = (first + n) % tab_count;
+            if (ti == active || !tab_ready[ti])
+                continue;
+            if (served && (late || now_ns() >= deadline))
+            {
+                if (!late)
+                    next_tab = ti;
+                tabs[ti].jobs_pending = late = 1; // may hold a reaped job too
+                continue;
+            }
+            check_jobs(&tabs[ti], JOB_READ_BUDGET, deadline);
+            served = any_ready = 1;
+        }
+        if (any_ready)
+            enforce_scrollback_budget(tabs, tab_count, active);
+        hist_poll(tabs, tab_count);
+        find_collect(tabs, tab_count, view_rows(win_h));
 
         while (XPending(dpy))
         {
             XEvent ev;
             XNextEvent(dpy, &ev);
+            if (ev.type == KeyPress || ev.type == ButtonPress)
+                ui_needs_redraw = 1; // the next frame diffs and repaints what changed
+            if (ev.type == ConfigureNotify &&
+                (ev.xconfigure.width != win_w || ev.xconfigure.height != win_h))
+            {
+                win_w = ev.xconfigure.width;
+                win_h = ev.xconfigure.height;
+                ui_needs_redraw = 1;
+            }
             if (ev.type == Expose)
             {
-                draw_ui(dpy, win, gc, tabs, tab_count, active);
+                if (!present_exposed(dpy, win, gc, &ev.xexpose))
+                    invalidate_ui();
             }
             else if (ev.type == ButtonPress)
             {
@@ -1229,8 +6104,8 @@ int main()
                     if (ev.xbutton.button == Button4)
                     { // scroll up
                         t->scroll_offset += 3;
-                        if (t->scroll_offset > t->tb.line_count - 1)
-                            t->scroll_offset = t->tb.line_count - 1;
+                        if (t->scroll_offset > tb_total_lines(&t->tb) - 1)
+                            t->scroll_offset = tb_total_lines(&t->tb) - 1;
                     }
                     else if (ev.xbutton.button == Button5)
                     { // scroll down
@@ -1238,7 +6113,6 @@ int main()
                         if (t->scroll_offset < 0)
                             t->scroll_offset = 0;
                     }
-                    draw_ui(dpy, win, gc, tabs, tab_count, active);
                     continue;
                 }
 
@@ -1272,25 +6146,36 @@ int main()
                 // --- Ctrl+C and Ctrl+Z handling ---
                 if ((ev.xkey.state & ControlMask) && (ks == XK_c || ks == XK_C))
                 {
-                    handle_sigint(SIGINT);
+                    tab_signal_fg(t, SIGINT);
                     continue;
                 }
                 if ((ev.xkey.state & ControlMask) && (ks == XK_z || ks == XK_Z))
                 {
-                    handle_sigtstp(SIGTSTP);
+                    tab_signal_fg(t, SIGTSTP);
+                    continue;
+                }
+
+                // --- Ctrl+F: scrollback search takes the keys while open ---
+                if ((t->find.active || (len > 0 && buf[0] == 6)) &&
+                    find_key(t, ks, len > 0 ? (unsigned char)buf[0] : 0, view_rows(win_h)))
+                    continue;
+
+                // --- Ctrl+R finder: arrows and paging move the selection ---
+                if (t->search_mode && (ks == XK_Up || ks == XK_Down || ks == XK_Page_Up || ks == XK_Page_Down))
+                {
+                    int page = hf_list_rows(view_rows(win_h));
+                    hf_move(&t->finder, ks == XK_Up ? -1 : ks == XK_Down ? 1 : ks == XK_Page_Up ? -page : page);
                     continue;
                 }
 
                 // === Scroll with keyboard ===
                 if (ks == XK_Up)
                 {
-                    if (t->hist_count > 0)
+                    int id = hist_step(t, -1);
+                    if (id >= 0)
                     {
-                        if (t->hist_index == -1)
-                            t->hist_index = t->hist_count - 1;
-                        else if (t->hist_index > 0)
-                            t->hist_index--;
-                        strncpy(t->input, t->history[t->hist_index], INPUT_MAX - 1);
+                        t->hist_index = id;
+                        strncpy(t->input, hidx_text(&shared_hist.hidx, id), INPUT_MAX - 1);
                         t->input_len = strlen(t->input);
                     }
                     continue;
@@ -1299,8 +6184,8 @@ int main()
                 {
                     if (t->hist_index >= 0)
                     {
-                        t->hist_index++;
-                        if (t->hist_index >= t->hist_count)
+                        t->hist_index = hist_step(t, 1);
+                        if (t->hist_index < 0)
                         {
                             t->hist_index = -1;
                             t->input[0] = '\0';
@@ -1308,7 +6193,7 @@ int main()
                         }
                         else
                         {
-                            strncpy(t->input, t->history[t->hist_index], INPUT_MAX - 1);
+                            strncpy(t->input, hidx_text(&shared_hist.hidx, t->hist_index), INPUT_MAX - 1);
                             t->input_len = strlen(t->input);
                         }
                     }
@@ -1317,9 +6202,8 @@ int main()
                 else if (ks == XK_Page_Up)
                 {
                     t->scroll_offset += 10;
-                    if (t->scroll_offset > t->tb.line_count - 1)
-                        t->scroll_offset = t->tb.line_count - 1;
-                    draw_ui(dpy, win, gc, tabs, tab_count, active);
+                    if (t->scroll_offset > tb_total_lines(&t->tb) - 1)
+                        t->scroll_offset = tb_total_lines(&t->tb) - 1;
                     continue;
                 }
                 else if (ks == XK_Page_Down)
@@ -1327,7 +6211,6 @@ int main()
                     t->scroll_offset -= 10;
                     if (t->scroll_offset < 0)
                         t->scroll_offset = 0;
-                    draw_ui(dpy, win, gc, tabs, tab_count, active);
                     continue;
                 }
 
@@ -1359,6 +6242,7 @@ int main()
                             t->search_mode = 1;
                             t->search_len = 0;
                             t->search_buf[0] = '\0';
+                            hf_open(t);
                             tb_append(&t->tb, "[Search mode enabled]");
                             ui_needs_redraw = 1;
                         }
@@ -1374,6 +6258,7 @@ int main()
                             t->search_mode = 0;
                             t->search_len = 0;
                             t->search_buf[0] = '\0';
+                            hf_close(&t->finder);
                             tb_append(&t->tb, "[Search cancelled]");
                             ui_needs_redraw = 1;
                             continue;
@@ -1385,6 +6270,7 @@ int main()
                             if (t->search_len > 0)
                             {
                                 t->search_buf[--t->search_len] = '\0';
+                                hf_update(t, t->search_buf);
                                 ui_needs_redraw = 1;
                             }
                             continue;
@@ -1393,6 +6279,21 @@ int main()
                         // Enter → search in history
                         if (c == '\r' || c == '\n')
                         {
+                            HistFinder *hf = &t->finder;
+                            if (hf->sel < hf->nmatch)
+                            {
+                                // take the chosen command into the input line
+                                snprintf(t->input, INPUT_MAX, "%s", hidx_text(&shared_hist.hidx, hf->ids[hf->ranked[hf->sel]]));
+                                t->input_len = strlen(t->input);
+                                t->cursor_pos = t->input_len;
+                                t->search_mode = 0;
+                                t->search_len = 0;
+                                t->search_buf[0] = '\0';
+                                hf_close(hf);
+                                ui_needs_redraw = 1;
+                                continue;
+                            }
+                            hf_close(hf);
                             if (t->search_len == 0)
                             {
                                 tb_append(&t->tb, "No term entered.");
@@ -1401,35 +6302,24 @@ int main()
                                 continue;
                             }
 
-                            int exact_idx = -1, partial_idx = -1, best_len = 0;
-                            for (int i = t->hist_count - 1; i >= 0; i--)
-                            {
-                                if (strcmp(t->history[i], t->search_buf) == 0)
-                                {
-                                    exact_idx = i;
-                                    break;
-                                }
-                                if (strstr(t->history[i], t->search_buf))
-                                {
-                                    int len = strlen(t->search_buf);
-                                    if (len > best_len)
-                                    {
-                                        best_len = len;
-                                        partial_idx = i;
-                                    }
-                                }
-                            }
+                            // nothing matches fuzzily: report the closest entry instead
+
+                            int exact_idx = history_exact_match(t->search_buf), partial_idx = -1;
+                            if (exact_idx < 0)
+                                partial_idx = history_prefix_match(t->search_buf);
+                            if (exact_idx < 0 && partial_idx < 0)
+                                partial_idx = history_longest_substring(t->search_buf);
 
                             if (exact_idx >= 0)
                             {
                                 char msg[INPUT_MAX + 64];
-                                snprintf(msg, sizeof(msg), "Exact match: %s", t->history[exact_idx]);
+                                snprintf(msg, sizeof(msg), "Exact match: %s", shared_hist.items[exact_idx]);
                                 tb_append(&t->tb, msg);
                             }
                             else if (partial_idx >= 0)
                             {
                                 char msg[INPUT_MAX + 64];
-                                snprintf(msg, sizeof(msg), "Closest match: %s", t->history[partial_idx]);
+                                snprintf(msg, sizeof(msg), "Closest match: %s", shared_hist.items[partial_idx]);
                                 tb_append(&t->tb, msg);
                             }
                             else
@@ -1449,6 +6339,7 @@ int main()
                         {
                             t->search_buf[t->search_len++] = c;
                             t->search_buf[t->search_len] = '\0';
+                            hf_update(t, t->search_buf);
                             ui_needs_redraw = 1;
                         }
                         continue;
@@ -1464,6 +6355,11 @@ int main()
                             t->input[t->input_len] = '\0';
                             t->multiline_mode = 1;
                         }
+                        else if (tab_has_fg_job(t))
+                        {
+                            tb_append(&t->tb, "[MyTerm] Foreground job still running (Ctrl+C to interrupt, Ctrl+Z to background)");
+                            ui_needs_redraw = 1;
+                        }
                         else
                         {
                             run_command(t);
@@ -1511,34 +6407,32 @@ int main()
                 }
             }
         }
-        // === Handle pending signal messages safely ===
-        if (signal_msg_ready && active >= 0)
+        // === Deliver Ctrl+C / Ctrl+Z from the launching terminal ===
+        if (pending_sig)
         {
-            tb_append(&tabs[active].tb, pending_signal_msg);
-            ui_needs_redraw = 1;
-            signal_msg_ready = 0;
+            int sig = pending_sig;
+            pending_sig = 0;
+            if (active >= 0)
+                tab_signal_fg(&tabs[active], sig);
         }
 
-        if (ui_needs_redraw)
+        if (ui_needs_redraw && now_ns() >= next_frame_ns)
         {
             draw_ui(dpy, win, gc, tabs, tab_count, active);
             ui_needs_redraw = 0;
+            next_frame_ns = now_ns() + frame_ns;
         }
-
-        // small sleep to avoid busy loop; jobs are polled each iteration
-        usleep(10000);
     }
     // cleanup on exit
+    journal_close();
     for (int i = 0; i < tab_count; i++)
     {
-        save_history(&tabs[i]);
         for (int j = 0; j < tabs[i].job_count; j++)
             if (tabs[i].jobs[j].active)
                 kill(tabs[i].jobs[j].pid, SIGKILL);
-        for (int h = 0; h < tabs[i].hist_count; h++)
-            free(tabs[i].history[h]);
         tb_free(&tabs[i].tb);
     }
+    hist_free();
 
     return 0;
 }